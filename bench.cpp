@@ -0,0 +1,437 @@
+// Benchmarks of the lexer, parser, template extraction and synthesis, and
+//   of the serializer, over a generated (and reproducible) corpus.
+// Build with optimizations, for instance:
+//   g++ -std=c++17 -O2 -pthread -o bench bench.cpp
+// Usage: bench [--time seconds] [filter]
+// Results are printed as JSON to the standard output, one entry per
+//   corpus and stage, with the throughput (relatively to the bytes the
+//   stage reads or writes, and null for the stages that only walk trees
+//   or bound values) and the allocations per document.
+
+#include "json.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <new>
+#include <random>
+
+// --------------------------------------------------------------------------------------
+// Allocation counting
+// --------------------------------------------------------------------------------------
+
+static std::atomic<std::size_t> allocations(0);
+static std::atomic<std::size_t> allocated(0);
+
+static void* M_allocate(std::size_t size, std::size_t align = 0)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated.fetch_add(size, std::memory_order_relaxed);
+
+    void* ptr = align ? std::aligned_alloc(align, (size + align - 1) / align * align) : std::malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(std::size_t size) { return M_allocate(size); }
+void* operator new[](std::size_t size) { return M_allocate(size); }
+void* operator new(std::size_t size, std::align_val_t align) { return M_allocate(size, static_cast<std::size_t>(align)); }
+void* operator new[](std::size_t size, std::align_val_t align) { return M_allocate(size, static_cast<std::size_t>(align)); }
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+// --------------------------------------------------------------------------------------
+// Corpus
+// --------------------------------------------------------------------------------------
+
+//! A document, and a template bound to its values.
+struct Corpus
+{
+    virtual ~Corpus() {}
+
+    //! Release what an extraction allocated (if anything).
+    virtual void clear() {}
+
+    std::string name;
+    std::string text;
+    json::Template tpl;
+};
+
+static std::string M_number(double value)
+{
+    json::Writer out;
+    out.number(value);
+    return out.str();
+}
+
+//! Arrays of coordinates (like canada.json).
+struct Numbers : Corpus
+{
+    Numbers(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<double> lon(-141.0, -52.0), lat(41.0, 83.0);
+
+        name = "numbers";
+        text = "{\"type\": \"Polygon\", \"coordinates\": [\n";
+        for (int i = 0; i < 100000; ++i)
+        {
+            if (i) text += ",\n";
+            text += "[" + M_number(lon(rng)) + ", " + M_number(lat(rng)) + "]";
+        }
+        text += "\n]}";
+
+        tpl.bind("type", type);
+        tpl.bind("coordinates", coordinates);
+    }
+
+    std::string type;
+    std::vector<std::vector<double>> coordinates;
+};
+
+//! Objects of short strings (like twitter.json).
+struct Strings : Corpus
+{
+    Strings(std::mt19937& rng)
+    {
+        static const char* words[] = {"lorem", "ipsum", "dolor", "sit", "amet,", "\\\"quoted\\\"", "tab\\t", "line\\n", "json", "@user"};
+        auto sentence = [&](int count)
+        {
+            std::string s;
+            for (int i = 0; i < count; ++i)
+                s += std::string(i ? " " : "") + words[rng() % 10];
+            return s;
+        };
+
+        name = "strings";
+        text = "{\"count\": 20000, \"statuses\": [\n";
+        for (int i = 0; i < 20000; ++i)
+        {
+            if (i) text += ",\n";
+            text += "{\"id_str\": \"" + std::to_string(rng()) + std::to_string(rng()) + "\", "
+                    "\"created_at\": \"Sun Aug 31 00:29:15 +0000 2014\", "
+                    "\"text\": \"" + sentence(12) + "\", "
+                    "\"user\": \"" + sentence(2) + "\", "
+                    "\"lang\": \"en\"}";
+        }
+        text += "\n]}";
+
+        tpl.bind("count", count);
+        tpl.bind("statuses", statuses);
+    }
+
+    int count;
+    std::vector<std::map<std::string, std::string>> statuses;
+};
+
+//! Deeply nested objects and arrays (like configuration files).
+struct Nested : Corpus
+{
+    Nested(std::mt19937& rng)
+    {
+        name = "nested";
+        text = "{\"name\": \"service\", \"sections\": [\n";
+        for (int i = 0; i < 500; ++i)
+        {
+            if (i) text += ",\n";
+            for (int d = 0; d < 32; ++d)
+                text += "{\"enabled\": true, \"limits\": [" + std::to_string(rng() % 100) + ", " + std::to_string(rng() % 1000) + "], \"level\": ";
+            text += "{\"value\": " + std::to_string(i) + "}";
+            text += std::string(32, '}');
+        }
+        text += "\n], \"root\": ";
+        for (int d = 0; d < 32; ++d)
+            text += "{\"level\": ";
+        text += "{\"value\": 42}" + std::string(32, '}') + "}";
+
+        // Only the innermost value of root is bound, so that extraction
+        //   mostly measures how fast unbound values are skipped
+        json::Template inner;
+        inner.bind("value", value);
+        for (int d = 0; d < 32; ++d)
+        {
+            json::Template outer;
+            outer.bind("level", inner);
+            inner = outer;
+        }
+
+        tpl.bind("name", name_);
+        tpl.bind("root", inner);
+    }
+
+    std::string name_;
+    int value;
+};
+
+//! A tree of included files.
+struct Includes : Corpus
+{
+    Includes(std::mt19937& rng, std::filesystem::path const& dir)
+    {
+        name = "includes";
+        text = "{\"parts\": [\n";
+        for (int i = 0; i < 200; ++i)
+        {
+            std::string file = (dir / ("part" + std::to_string(i) + ".json")).string();
+            std::ofstream fs(file);
+            fs << "{\"id\": " << i;
+            for (int j = 0; j < 50; ++j)
+                fs << ", \"k" << j << "\": " << rng() % 1000;
+            fs << "}";
+
+            if (i) text += ",\n";
+            text += "@\"" + file + "\"";
+        }
+        text += "\n]}";
+
+        tpl.bind("parts", parts);
+    }
+
+    std::vector<std::map<std::string, int>> parts;
+};
+
+//! A large binary blob, bound with ref_as_raw().
+struct Blob : Corpus
+{
+    Blob(std::mt19937& rng)
+    {
+        std::vector<uint8_t> data(4 << 20);
+        for (auto& byte : data)
+            byte = static_cast<uint8_t>(rng());
+
+        name = "blob";
+        text = "{\"name\": \"firmware\", \"data\": \"";
+        text.resize(text.size() + json::Hex::encodedSize(data.size()));
+        json::Hex::encode(data.data(), data.size(), &text[text.size() - json::Hex::encodedSize(data.size())]);
+        text += "\"}";
+
+        tpl.bind("name", name_);
+        tpl.bind("data", json::ref_as_raw(ptr, size));
+    }
+
+    ~Blob()
+    { clear(); }
+
+    void clear()
+    {
+        delete[] ptr;
+        ptr = nullptr;
+        size = 0;
+    }
+
+    std::string name_;
+    uint8_t* ptr = nullptr;
+    std::size_t size = 0;
+};
+
+// --------------------------------------------------------------------------------------
+// Measurements
+// --------------------------------------------------------------------------------------
+
+struct Result
+{
+    std::string corpus;
+    std::string stage;
+    //! Bytes read or written by an iteration (0 if meaningless)
+    std::size_t bytes;
+    std::size_t iterations;
+    double seconds;
+    double allocations;
+    double allocated;
+};
+
+//! Run the function repeatedly for at least the given time, the
+//!   function returning the number of bytes it read or wrote.
+static Result M_measure(Corpus const& corpus, std::string const& stage, double time, std::function<std::size_t()> const& run)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // Warm up
+    std::size_t processed = run();
+
+    std::size_t iterations = 0;
+    std::size_t count = allocations.load();
+    std::size_t bytes = allocated.load();
+
+    Clock::time_point start = Clock::now();
+    double elapsed = 0;
+    do
+    {
+        run();
+        ++iterations;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    while (elapsed < time);
+
+    Result result;
+    result.corpus = corpus.name;
+    result.stage = stage;
+    result.bytes = processed;
+    result.iterations = iterations;
+    result.seconds = elapsed / iterations;
+    result.allocations = double(allocations.load() - count) / iterations;
+    result.allocated = double(allocated.load() - bytes) / iterations;
+    return result;
+}
+
+static void M_print(json::Writer& out, Result const& result)
+{
+    out.write("    {\"corpus\": ");
+    out.string(result.corpus);
+    out.write(", \"stage\": ");
+    out.string(result.stage);
+    out.write(", \"bytes\": ");
+    if (result.bytes)
+        out.number(result.bytes);
+    else
+        out.write("null");
+    out.write(", \"iterations\": ");
+    out.number(result.iterations);
+    out.write(", \"seconds\": ");
+    out.number(result.seconds);
+    out.write(", \"mb_per_s\": ");
+    if (result.bytes)
+        out.number(result.bytes / result.seconds / 1e6);
+    else
+        out.write("null");
+    out.write(", \"allocs_per_doc\": ");
+    out.number(result.allocations);
+    out.write(", \"alloc_bytes_per_doc\": ");
+    out.number(result.allocated);
+    out.put('}');
+}
+
+int main(int argc, char** argv)
+{
+    double time = 0.5;
+    std::string filter;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--time" && i + 1 < argc)
+            time = std::atof(argv[++i]);
+        else
+            filter = argv[i];
+    }
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "json-bench";
+    std::filesystem::create_directories(dir);
+
+    std::mt19937 rng(20140831);
+    std::vector<std::unique_ptr<Corpus>> corpora;
+    corpora.push_back(std::make_unique<Numbers>(rng));
+    corpora.push_back(std::make_unique<Strings>(rng));
+    corpora.push_back(std::make_unique<Nested>(rng));
+    corpora.push_back(std::make_unique<Includes>(rng, dir));
+    corpora.push_back(std::make_unique<Blob>(rng));
+
+    std::vector<Result> results;
+    for (auto& corpus : corpora)
+    {
+        Corpus& c = *corpus;
+        auto add = [&](std::string const& stage, std::function<std::size_t()> const& run)
+        {
+            std::string id = c.name + "/" + stage;
+            if (id.find(filter) != std::string::npos)
+                results.push_back(M_measure(c, stage, time, run));
+        };
+
+        add("lex", [&]()
+        {
+            json::Lexer lex(c.text.data(), c.text.size(), true);
+            while (lex.get().type() != json::Token::Eof)
+                ;
+            return c.text.size();
+        });
+
+        add("parse", [&]()
+        {
+            json::Lexer lex(c.text.data(), c.text.size());
+            json::Parser parser(lex);
+            delete parser.parse();
+            return c.text.size();
+        });
+
+        add("document", [&]()
+        {
+            json::Document doc;
+            doc.parse(c.text.data(), c.text.size());
+            return c.text.size();
+        });
+
+        // The whole document is read, unbound values being skipped
+        add("extract", [&]()
+        {
+            c.clear();
+            json::Lexer lex(c.text.data(), c.text.size());
+            c.tpl.extract(lex);
+            return c.text.size();
+        });
+
+        json::Document doc;
+        json::Node* root = doc.parse(c.text.data(), c.text.size());
+
+        // Only the bound nodes are visited (see Nested), and no text is
+        //   read, hence no throughput
+        add("extract_tree", [&]()
+        {
+            c.clear();
+            c.tpl.extract(root);
+            return std::size_t(0);
+        });
+
+        // Values are bound again for the next stages
+        c.clear();
+        c.tpl.extract(root);
+
+        // Nodes are built without writing any text, hence no throughput
+        add("synthetize", [&]()
+        {
+            delete c.tpl.synthetize();
+            return std::size_t(0);
+        });
+
+        // The written text differs from the document (by its indentation)
+        add("serialize", [&]()
+        {
+            json::Writer out;
+            root->serialize(out, true);
+            return out.str().size();
+        });
+    }
+
+    std::filesystem::remove_all(dir);
+
+    json::Writer out(std::cout);
+    out.write("{\"context\": {\"compiler\": ");
+    out.string(__VERSION__);
+    out.write(", \"min_time\": ");
+    out.number(time);
+#if defined(JSON_HAS_AVX2)
+    out.write(", \"simd\": \"avx2\"");
+#elif defined(JSON_HAS_SSE2)
+    out.write(", \"simd\": \"sse2\"");
+#elif defined(JSON_HAS_NEON)
+    out.write(", \"simd\": \"neon\"");
+#else
+    out.write(", \"simd\": \"none\"");
+#endif
+    out.write("},\n \"benchmarks\": [\n");
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        M_print(out, results[i]);
+        out.write(i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out.write("]}\n");
+
+    return 0;
+}
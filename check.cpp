@@ -0,0 +1,380 @@
+// Regression checks of the library's less travelled paths (includes,
+//   streaming parsers, lazy documents...), that are not exercised by the
+//   examples of main.cpp.
+// Build with sanitizers, for instance:
+//   g++ -std=c++17 -g -pthread -fsanitize=address,undefined -o check check.cpp
+// Usage: check
+// Each check prints its name and result, and the program fails if any
+//   of them does.
+
+#include "json.h"
+
+#include <filesystem>
+#include <functional>
+
+struct Fields
+{
+    int a;
+    std::vector<int> v;
+    std::map<std::string, int> m;
+};
+JSON_FIELDS(Fields, a, v, m)
+
+static std::filesystem::path dir;
+static int failures = 0;
+
+static void M_check(std::string const& name, std::function<bool()> const& run)
+{
+    bool ok = false;
+    try
+    {
+        ok = run();
+    }
+    catch (std::exception const& e)
+    {
+        std::cout << "   (" << e.what() << ")" << std::endl;
+    }
+
+    std::cout << (ok ? "ok     " : "FAILED ") << name << std::endl;
+    if (!ok)
+        ++failures;
+}
+
+//! Tell if running the function throws (the error is printed).
+static bool M_throws(std::function<void()> const& run)
+{
+    try
+    {
+        run();
+    }
+    catch (std::exception const& e)
+    {
+        std::cout << "   " << e.what() << std::endl;
+        return true;
+    }
+
+    return false;
+}
+
+//! Write a file in the checks' directory, returning its path.
+static std::string M_file(std::string const& name, std::string const& text)
+{
+    std::string path = (dir / name).string();
+    std::ofstream(path) << text;
+    return path;
+}
+
+//! Serialize a node on a single line.
+static std::string M_text(json::Node* node)
+{
+    std::ostringstream out;
+    json::serialize(node, out, false);
+    return out.str();
+}
+
+int main()
+{
+    dir = std::filesystem::temp_directory_path() / "json-check";
+    std::filesystem::create_directories(dir);
+
+    // a.json and b.json include each other
+    std::string a = M_file("a.json", "{\"x\": @\"" + (dir / "b.json").string() + "\"}");
+    std::string b = M_file("b.json", "{\"y\": @\"" + (dir / "a.json").string() + "\"}");
+
+    M_check("include cycle while parsing", [&]()
+    {
+        return M_throws([&]() { delete json::parse(a); });
+    });
+
+    M_check("include cycle while extracting", [&]()
+    {
+        int value;
+        json::Template x, y, z, t;
+        t.bind("y", value);
+        z.bind("x", t);
+        y.bind("y", z);
+        x.bind("x", y);
+        return M_throws([&]() { json::extract(x, a); });
+    });
+
+    M_check("include cycle while reading events", [&]()
+    {
+        json::ReaderHandler handler;
+        return M_throws([&]() { json::read(a, handler); });
+    });
+
+    M_check("redefined key while reading events", [&]()
+    {
+        // Past JSON_OBJECT_INDEX_THRESHOLD keys, so that they are hashed
+        std::string text = "{";
+        for (int i = 0; i < 40; ++i)
+            text += "\"k" + std::to_string(i) + "\": " + std::to_string(i) + ", ";
+        std::istringstream small("{\"k\": 1, \"k\": 2}"), large(text + "\"k7\": 7}");
+
+        json::ReaderHandler handler;
+        return M_throws([&]() { json::read(small, handler); }) &&
+               M_throws([&]() { json::read(large, handler); });
+    });
+
+    M_check("select through an include", [&]()
+    {
+        std::string inc = M_file("inc.json", "{\"b\": 1}");
+        std::string top = M_file("top.json", "{\"a\": @\"" + inc + "\", \"c\": {\"b\": 2}}");
+
+        std::vector<json::Node*> nodes = json::select(top, "/a/b");
+        bool ok = nodes.size() == 1 && nodes[0]->type() == json::Node::Number &&
+                  nodes[0]->downcast<json::NumberNode>()->value() == 1;
+        for (json::Node* node : nodes)
+            delete node;
+        return ok;
+    });
+
+    M_check("include cycle while selecting", [&]()
+    {
+        return M_throws([&]() { json::select(a, "/*/*/*/*"); });
+    });
+
+    M_check("erasing object entries", [&]()
+    {
+        // Past JSON_OBJECT_INDEX_THRESHOLD keys, so that they are hashed
+        std::string text = "{";
+        for (int i = 0; i < 40; ++i)
+            text += "\"k" + std::to_string(i) + "\": " + std::to_string(i) + (i < 39 ? ", " : "}");
+        std::unique_ptr<json::Node> root(json::parse(text.data(), text.size()));
+        json::ObjectNode* obj = root->downcast<json::ObjectNode>();
+
+        bool ok = true;
+        for (int i = 0; i < 40; i += 2)
+        {
+            std::unique_ptr<json::Node> value(obj->erase("k" + std::to_string(i)));
+            ok = ok && value && value->downcast<json::NumberNode>()->value() == i;
+        }
+        delete obj->value(0);
+        obj->value(0) = new json::StringNode("one");
+
+        ok = ok && !obj->erase("k0") && obj->size() == 20 && obj->impl()[0].first == "k1" &&
+             obj->find("k1")->type() == json::Node::String;
+        for (int i = 3; ok && i < 40; i += 2)
+            ok = obj->find("k" + std::to_string(i))->downcast<json::NumberNode>()->value() == i;
+        return ok;
+    });
+
+    M_check("push parser fed in chunks of any size", [&]()
+    {
+        // Chunks end in the middle of strings, escapes, numbers and words
+        std::vector<std::string> docs = {
+            "{\"s\": \"a\\\"b\\\\c\\nd\\te\", \"n\": [-12.5e3, 0, 123456789, 1.25], \"o\": {\"t\": true, \"f\": false, \"z\": null}}",
+            "[1, \"x\\ty\", {\"k\": -0.5}, []]",
+            "{\"long key with spaces\": \"and a value long enough to span chunks\"}"};
+
+        std::string text;
+        std::vector<std::string> expected;
+        for (std::string const& doc : docs)
+        {
+            text += doc + "\n";
+            std::unique_ptr<json::Node> root(json::parse(doc.data(), doc.size()));
+            expected.push_back(M_text(root.get()));
+        }
+
+        for (std::size_t chunk : {std::size_t(1), std::size_t(2), std::size_t(3), std::size_t(5),
+                                  std::size_t(7), std::size_t(13), text.size()})
+        {
+            std::vector<std::string> values;
+            json::PushParser parser([&](json::Node* node) { values.push_back(M_text(node)); });
+            for (std::size_t i = 0; i < text.size(); i += chunk)
+                parser.feed(text.data() + i, std::min(chunk, text.size() - i));
+            parser.finish();
+
+            if (values != expected)
+            {
+                std::cout << "   chunks of " << chunk << " characters" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    });
+
+    M_check("binary round trip and truncated encodings", [&]()
+    {
+        // Past JSON_PACKED_ARRAY_THRESHOLD items, arrays of numbers are
+        //   packed (integers, or reals some of which are integral), unlike
+        //   the ones with other values
+        std::string ints, reals, mixed;
+        for (int i = 0; i < 20; ++i)
+        {
+            ints += std::to_string(i - 10) + ", ";
+            reals += (i % 2 ? std::to_string(i) + ".5, " : std::to_string(i) + ", ");
+            mixed += std::to_string(i) + ", ";
+        }
+        std::string text = "{\"ints\": [" + ints + "-9223372036854775807], \"reals\": [" + reals + "-3e10], "
+                           "\"mixed\": [" + mixed + "\"a\", null, [true]], \"big\": 18446744073709551615, "
+                           "\"s\": \"x\\ny\", \"o\": {\"f\": false, \"e\": {}}}";
+        json::Document doc;
+        json::ObjectNode* root = doc.parse(text.data(), text.size())->downcast<json::ObjectNode>();
+        bool ok = root->find("ints")->downcast<json::ArrayNode>()->packed() &&
+                  root->find("reals")->downcast<json::ArrayNode>()->packed() &&
+                  !root->find("mixed")->downcast<json::ArrayNode>()->packed();
+
+        std::string data = json::Binary::encode(root);
+        std::unique_ptr<json::Node> decoded(json::parse_binary(data.data(), data.size()));
+        ok = ok && M_text(decoded.get()) == M_text(root) && json::Binary::encode(decoded.get()) == data;
+
+        for (std::size_t size = 0; ok && size < data.size(); ++size)
+        {
+            try
+            {
+                delete json::parse_binary(data.data(), size);
+                std::cout << "   truncated to " << size << " bytes" << std::endl;
+                ok = false;
+            }
+            catch (std::exception const&)
+            {
+            }
+        }
+        return ok;
+    });
+
+    M_check("mismatching value in a push parser", [&]()
+    {
+        int value;
+        json::Template tpl;
+        tpl.bind("value", value);
+
+        json::PushParser parser(tpl, [](json::Node*) {});
+        const char text[] = "{\"value\": 1} {\"value\": \"one\"}";
+        try
+        {
+            parser.feed(text, sizeof(text) - 1);
+        }
+        catch (json::NodeError const& e)
+        {
+            std::cout << "   " << e.message() << std::endl;
+            return value == 1 && e.token().info().column == 24;
+        }
+
+        return false;
+    });
+
+    M_check("missing values of a lazy document", [&]()
+    {
+        json::LazyDocument doc;
+        const char text[] = "{\"a\": {\"b\": [1, 2]}}";
+        json::LazyNode root = doc.parse(text, sizeof(text) - 1);
+
+        json::LazyNode missing = root.find("x").find("y").at(3);
+        return !missing && missing.type() == json::Node::Null && missing.size() == 0 &&
+               missing.key(0).empty() && !missing.node() && root.get("a").get("b").size() == 2;
+    });
+
+    M_check("lazy parent reusing its parsed children", [&]()
+    {
+        json::LazyDocument doc;
+        const char text[] = "{\"a\": {\"b\": [1, 2], \"c\": \"d\"}, \"e\": [{\"f\": null}]}";
+        json::LazyNode root = doc.parse(text, sizeof(text) - 1);
+
+        json::Node* b = root.get("a").get("b").node();
+        json::Node* f = root.get("e").at(0).get("f").node();
+        json::ObjectNode* node = root.node()->downcast<json::ObjectNode>();
+        json::ObjectNode* a = node->get("a")->downcast<json::ObjectNode>();
+        json::ArrayNode* e = node->get("e")->downcast<json::ArrayNode>();
+
+        return a->get("b") == b && e->at(0)->downcast<json::ObjectNode>()->get("f") == f &&
+               a->get("c")->downcast<json::StringNode>()->value() == "d";
+    });
+
+    M_check("lazy children reusing their parsed parent", [&]()
+    {
+        json::LazyDocument doc;
+        const char text[] = "{\"a\": {\"b\": [1, 2], \"c\": \"d\"}, \"e\": [{\"f\": null}]}";
+        json::LazyNode root = doc.parse(text, sizeof(text) - 1);
+
+        json::ObjectNode* node = root.node()->downcast<json::ObjectNode>();
+        json::ObjectNode* a = node->get("a")->downcast<json::ObjectNode>();
+        json::ArrayNode* b = a->get("b")->downcast<json::ArrayNode>();
+        json::ArrayNode* e = node->get("e")->downcast<json::ArrayNode>();
+
+        return root.get("a").node() == a && root.get("a").get("b").at(1).node() == b->at(1) &&
+               root.get("e").at(0).get("f").node() == e->at(0)->downcast<json::ObjectNode>()->get("f");
+    });
+
+    M_check("mismatching items while streaming with a status", [&]()
+    {
+        std::vector<int> values;
+        std::map<std::string, std::vector<int>> map;
+        json::Template tpl, tmap;
+        tpl.bind("values", values);
+        tmap.bind("map", map);
+        json::Plan plan = tpl.compile();
+
+        const char text[] = "{\"values\": [1, 2, \"three\"]}";
+        const char nested[] = "{\"map\": {\"a\": [1], \"b\": [true]}}";
+        json::Status status, other, tree;
+
+        json::Lexer lex(text, sizeof(text) - 1);
+        bool ok = !plan.extract(lex, status) && status.code() == json::Status::Mismatch &&
+             status.token().info().column == 19 && values == std::vector<int>({1, 2});
+        std::cout << "   " << status.message() << std::endl;
+
+        json::Lexer sub(nested, sizeof(nested) - 1);
+        ok = ok && !tmap.extract(sub, other) && other.code() == json::Status::Mismatch &&
+             map.size() == 1 && map.count("a");
+        std::cout << "   " << other.message() << std::endl;
+
+        std::unique_ptr<json::Node> root(json::parse(text, sizeof(text) - 1));
+        return ok && !tpl.extract(root.get(), tree) && tree.code() == json::Status::Mismatch;
+    });
+
+    M_check("redefined unbound key while extracting from the lexer", [&]()
+    {
+        int value;
+        std::vector<int> values;
+        std::map<std::string, int> map;
+        Fields fields;
+        json::Template tpl, reflected;
+        tpl.bind("a", value);
+        tpl.bind("v", values);
+        tpl.bind("m", map);
+        reflected.bind("r", fields);
+        json::Plan plan = tpl.compile();
+
+        const std::string text = "{\"a\":1,\"v\":[],\"m\":{},\"zz\":1,\"zz\":2}";
+        const std::string nested = "{\"r\": " + text + "}";
+        json::Status status;
+        json::Lexer lex(text.data(), text.size()), sub(text.data(), text.size());
+        json::Lexer other(nested.data(), nested.size());
+
+        bool ok = !plan.extract(lex, status) && status.code() == json::Status::Syntax &&
+                  status.what() == "redifinition of object entry `zz'";
+        std::cout << "   " << status.message() << std::endl;
+        return ok && M_throws([&]() { tpl.extract(sub); }) &&
+               M_throws([&]() { reflected.extract(other); }) &&
+               M_throws([&]() { delete json::parse(text.data(), text.size()); });
+    });
+
+    M_check("status outliving its input", [&]()
+    {
+        int value;
+        json::Template tpl;
+        tpl.bind("value", value);
+
+        // The key and the offending token refer to the mapped file
+        std::string path = M_file("status.json", "{\"value\": 1, \"value\": 2}");
+        json::Status status, missing;
+        bool failed = !json::extract(tpl, path, status);
+        {
+            json::Template other;
+            other.bind("other", value);
+            std::unique_ptr<json::Node> root(json::parse(M_file("missing.json", "{\"value\": 1}")));
+            other.compile().extract(root.get(), missing);
+        }
+
+        std::cout << "   " << status.message() << std::endl;
+        std::cout << "   " << missing.message() << std::endl;
+        return failed && status.code() == json::Status::Syntax &&
+               status.what() == "redifinition of object entry `value'" &&
+               missing.what() == "json::Object::extract: missing element `other'";
+    });
+
+    std::filesystem::remove_all(dir);
+    return failures ? 1 : 0;
+}
@@ -31,9 +31,49 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_set>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <algorithm>
+#include <cstring>
 #include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <charconv>
+#include <type_traits>
+#include <atomic>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <chrono>
+#include <optional>
+#include <tuple>
+#include <bitset>
 #include <stdexcept>
 
+#if !defined(JSON_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# define JSON_HAS_MMAP 1
+#endif
+
+#if !defined(JSON_NO_SIMD) && defined(__GNUC__)
+# if defined(__AVX2__)
+#  include <immintrin.h>
+#  define JSON_HAS_AVX2 1
+# elif defined(__SSE2__)
+#  include <emmintrin.h>
+#  define JSON_HAS_SSE2 1
+# elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define JSON_HAS_NEON 1
+# endif
+#endif
+
 #ifndef JSON_START_NAMESPACE
 # define JSON_START_NAMESPACE namespace json {
 #endif
@@ -52,8 +92,10 @@ JSON_START_NAMESPACE
 // Forward declarations
 // --------------------------------------------------------------------------------------
 
+class Text;
 class Token;
 class Lexer;
+class Writer;
 class NumberNode;
 class BooleanNode;
 class StringNode;
@@ -61,9 +103,28 @@ class ObjectNode;
 class ArrayNode;
 class Node;
 class Parser;
+template <typename H> class Reader;
+template <typename T, typename E = void> struct Codec;
+class Selector;
+class MappedFile;
+class Arena;
+struct Stats;
+class StatsObserver;
+class Document;
+class SharedDocument;
+class Include;
+class IncludeResolver;
+class StreamReader;
+class PushParser;
+class LazyNode;
+class LazyDocument;
+struct Binary;
+class BinaryValue;
 class NodeError;
+class Status;
 class Element;
 class Template;
+class Plan;
 
 // --------------------------------------------------------------------------------------
 // Utility template
@@ -71,16 +132,157 @@ class Template;
 
 Node* parse(std::string const& file);
 Node* parse(std::istream& file);
+Node* parse(const char* data, std::size_t size);
+Node* parse(std::string const& file, Status& status);
+Node* parse(std::istream& file, Status& status);
+Node* parse(const char* data, std::size_t size, Status& status);
 
 void serialize(Node* node, std::string const& file, bool indent = true);
 void serialize(Node* node, std::ostream& file, bool indent = true);
 
+Node* parse_binary(std::string const& file);
+Node* parse_binary(std::istream& file);
+Node* parse_binary(const char* data, std::size_t size);
+
+void serialize_binary(Node* node, std::string const& file);
+void serialize_binary(Node* node, std::ostream& file);
+
 void extract(Template const& tpl, std::string const& file);
 void extract(Template const& tpl, std::istream& file);
+void extract(Plan const& plan, std::string const& file);
+void extract(Plan const& plan, std::istream& file);
+bool extract(Template const& tpl, std::string const& file, Status& status);
+bool extract(Template const& tpl, std::istream& file, Status& status);
+bool extract(Plan const& plan, std::string const& file, Status& status);
+bool extract(Plan const& plan, std::istream& file, Status& status);
+
+void extract_partial(Template const& tpl, std::string const& file);
+void extract_partial(Template const& tpl, std::istream& file);
+void extract_partial(Plan const& plan, std::string const& file);
+void extract_partial(Plan const& plan, std::istream& file);
 
 void synthetize(Template const& tpl, std::string const& file, bool indent = true);
 void synthetize(Template const& tpl, std::ostream& file, bool indent = true);
 
+template <typename H> void read(std::string const& file, H& handler);
+template <typename H> void read(std::istream& file, H& handler);
+
+std::vector<Node*> select(std::string const& file, std::string const& path);
+std::vector<Node*> select(std::istream& file, std::string const& path);
+
+// --------------------------------------------------------------------------------------
+// Text
+// --------------------------------------------------------------------------------------
+
+//! Characters that are either owned, or only referred to when they
+//!   live in a buffer that outlives them (typically a mapped file).
+//! Both cases share the same pointer and size, the ownership being
+//!   tagged in the highest bit of the size.
+class Text
+{
+public:
+    Text() : m_data(nullptr), m_size(M_owned) {}
+    Text(std::string_view str) : m_data(M_copy(str)), m_size(str.size() | M_owned) {}
+    Text(std::string const& str) : Text(std::string_view(str)) {}
+    Text(const char* str) : Text(std::string_view(str)) {}
+
+    Text(Text const& other) :
+        m_data(other.owned() ? M_copy(other.view()) : other.m_data),
+        m_size(other.m_size)
+    {}
+
+    Text(Text&& other) noexcept :
+        m_data(other.m_data),
+        m_size(other.m_size)
+    {
+        other.m_data = nullptr;
+        other.m_size = M_owned;
+    }
+
+    ~Text()
+    { M_free(); }
+
+    Text& operator=(Text const& other)
+    {
+        if (this != &other)
+            *this = Text(other);
+        return *this;
+    }
+
+    Text& operator=(Text&& other) noexcept
+    {
+        if (this != &other)
+        {
+            M_free();
+            m_data = other.m_data;
+            m_size = other.m_size;
+            other.m_data = nullptr;
+            other.m_size = M_owned;
+        }
+        return *this;
+    }
+
+    //! Refer to characters owned by someone else, without copying them.
+    static Text reference(std::string_view chars)
+    {
+        Text text;
+        text.m_data = chars.data();
+        text.m_size = chars.size();
+        return text;
+    }
+
+    bool owned() const
+    { return m_size & M_owned; }
+
+    std::string_view view() const
+    { return std::string_view(m_data, m_size & ~M_owned); }
+
+    std::string str() const
+    { return std::string(view()); }
+
+    //! Copy the characters out, releasing them.
+    std::string release()
+    {
+        std::string str(view());
+        *this = Text();
+        return str;
+    }
+
+    friend bool operator==(Text const& lhs, Text const& rhs) { return lhs.view() == rhs.view(); }
+    friend bool operator==(Text const& lhs, std::string_view rhs) { return lhs.view() == rhs; }
+    friend bool operator==(Text const& lhs, std::string const& rhs) { return lhs.view() == rhs; }
+    friend bool operator==(Text const& lhs, const char* rhs) { return lhs.view() == rhs; }
+    friend bool operator<(Text const& lhs, Text const& rhs) { return lhs.view() < rhs.view(); }
+    friend bool operator<(Text const& lhs, std::string_view rhs) { return lhs.view() < rhs; }
+    friend bool operator<(std::string_view lhs, Text const& rhs) { return lhs < rhs.view(); }
+
+    friend std::ostream& operator<<(std::ostream& out, Text const& text)
+    { return out << text.view(); }
+
+private:
+    static constexpr std::size_t M_owned = ~(~std::size_t(0) >> 1);
+
+    static const char* M_copy(std::string_view str)
+    {
+        if (str.empty())
+            return nullptr;
+
+        char* data = new char[str.size()];
+        std::memcpy(data, str.data(), str.size());
+        return data;
+    }
+
+    void M_free()
+    {
+        if (owned())
+            delete[] m_data;
+    }
+
+private:
+    const char* m_data;
+    std::size_t m_size;
+};
+
 // --------------------------------------------------------------------------------------
 // Token
 // --------------------------------------------------------------------------------------
@@ -106,16 +308,25 @@ public:
         Include
     };
 
+    //! Describe the shape of number tokens.
+    enum Flags
+    {
+        Integral = 1 << 0,
+        Negative = 1 << 1
+    };
+
     struct Info
     {
         bool empty;
         int line, column;
+        std::size_t offset;
     };
 
 public:
-    Token(Type type = Bad, std::string const& value = "") :
+    Token(Type type = Bad, Text value = Text(), unsigned flags = 0) :
         m_type(type),
-        m_value(value)
+        m_value(std::move(value)),
+        m_flags(flags)
     {
         m_info.empty = true;
     }
@@ -123,9 +334,19 @@ public:
     Type type() const
     { return m_type; }
 
-    std::string const& value() const
+    unsigned flags() const
+    { return m_flags; }
+
+    std::string_view value() const
+    { return m_value.view(); }
+
+    Text const& text() const
     { return m_value; }
 
+    //! Move the value out of the token (see Text::release()).
+    std::string release()
+    { return m_value.release(); }
+
     void setInfo(Info const& info)
     {
         m_info = info;
@@ -137,7 +358,8 @@ public:
 
 private:
     Type m_type;
-    std::string m_value;
+    Text m_value;
+    unsigned m_flags;
     Info m_info;
 };
 
@@ -169,6 +391,8 @@ private:
 };
 
 //! Common exception class to keep track of offending nodes.
+//! When extracting directly from the input (without building nodes),
+//!   the offending token is kept instead.
 class NodeError : public std::runtime_error
 {
 public:
@@ -177,1765 +401,8803 @@ public:
         m_node(node)
     {}
 
+    NodeError(Token const& token, std::string const& what) :
+        std::runtime_error(what),
+        m_node(nullptr),
+        m_token(token)
+    {}
+
     Node* node() const noexcept { return m_node; }
+
+    //! Get the offending token (the one of the offending node, if any).
+    Token token() const;
+
+    std::string message() const
+    {
+        std::ostringstream ss;
+        ss << "Node error [" << token().info().line
+           << ":" << token().info().column << "]"
+           << ": " << what();
+        return ss.str();
+    }
     
 private:
     Node* m_node;
+    Token m_token;
 };
 
 // --------------------------------------------------------------------------------------
-// Lexer
+// Memory
 // --------------------------------------------------------------------------------------
 
-class Lexer
+//! A whole file mapped read-only in memory (or read in memory on
+//!   systems, or for files, that don't support memory mappings).
+class MappedFile
 {
 public:
-    Lexer(std::istream& in) :
-        m_in(in)
-    { M_init(); }
+    MappedFile() : m_data(nullptr), m_size(0), m_mapped(false) {}
+    ~MappedFile() { close(); }
 
-    ~Lexer()
-    {}
-    
-    //! Get the next token from the input stream.
-    Token get()
-    {
-        Token tok = m_nextToken;
-        m_nextToken = M_getToken();
-        return tok;
-    }
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
 
-    //! Seek for the next token in the input stream
-    //!   (but do NOT extract it).
-    Token const& seek() const
-    { return m_nextToken; }
-    
-private:
-    //! Init the lexer (called from constructors).
-    void M_init()
+    //! Map the given file, returns false if it can't be opened.
+    bool open(std::string const& file)
     {
-        m_currentInfo.line = 1;
-        m_currentInfo.column = 0;
-
-        // Get first char (m_nextChar is now valid)
-        m_nextChar = 0;
-        M_getChar();
-        // Get first token (m_nextToken is now valid)
-        m_nextToken = M_getToken();
-    }
+        close();
 
-    //! Extract a character from the input stream.
-    //! This method manages the position in the input
-    //!   stream for debug and error messages purposes.
-    int M_getChar()
-    {
-        int ch = m_nextChar;
-        m_nextChar = m_in.get();
+#if JSON_HAS_MMAP
+        int fd = ::open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
 
-        // Update stream information
-        if (ch == '\n')
+        struct stat st;
+        bool regular = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+        if (regular)
         {
-            ++m_currentInfo.line;
-            m_currentInfo.column = 0;
+            m_size = static_cast<std::size_t>(st.st_size);
+
+            void* addr = m_size ? ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+            if (addr != MAP_FAILED)
+            {
+                m_data = static_cast<const char*>(addr);
+                m_mapped = true;
+            }
         }
-        ++m_currentInfo.column;
+        ::close(fd);
 
-        return ch;
+        if (m_mapped || (regular && m_size == 0))
+            return true;
+#endif
+
+        // Fallback to reading the whole file
+        std::ifstream fs(file, std::ios::in | std::ios::binary);
+        if (!fs)
+            return false;
+
+        m_buffer.assign(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+        return true;
     }
 
-    //! Skip whitespaces (and new lines).
-    void M_skipWs()
+    void close()
     {
-        while (std::isspace(m_nextChar) || m_nextChar == '\n')
-        {
-            M_getChar();
-            if (m_nextChar < 0) return;
-        }
+#if JSON_HAS_MMAP
+        if (m_mapped)
+            ::munmap(const_cast<char*>(m_data), m_size);
+#endif
+
+        m_buffer.clear();
+        m_data = nullptr;
+        m_size = 0;
+        m_mapped = false;
     }
 
-    //! Skip comments, starting with a hashtag '#'.
-    void M_skipComments()
-    {
-        while (m_nextChar == '#')
-        {
-            while (m_nextChar != '\n')
-            {
-                M_getChar();
-                if (m_nextChar < 0) return;
-            }
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
 
-            M_skipWs();
-        }
+private:
+    const char* m_data;
+    std::size_t m_size;
+    bool m_mapped;
+    std::string m_buffer;
+};
+
+//! A bump allocator: memory is carved from large blocks, that are only
+//!   released all at once (without running any destructor).
+//! Node containers allocate from the arena through its memory resource.
+class Arena
+{
+public:
+    Arena(std::size_t initial = 4096) : m_resource(initial) {}
+
+    Arena(Arena const&) = delete;
+    Arena& operator=(Arena const&) = delete;
+
+    std::pmr::memory_resource* resource()
+    { return &m_resource; }
+
+    //! Construct an object in the arena.
+    template <typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        void* ptr = m_resource.allocate(sizeof(T), alignof(T));
+        return new (ptr) T(std::forward<Args>(args)...);
     }
 
-    //! Skip whitespaces and comments.
-    void M_skip()
+    //! Copy characters in the arena.
+    Text intern(std::string_view chars)
     {
-        M_skipWs();
-        M_skipComments();
-        M_skipWs();
+        if (chars.empty())
+            return Text::reference(chars);
+
+        char* ptr = static_cast<char*>(m_resource.allocate(chars.size(), 1));
+        std::memcpy(ptr, chars.data(), chars.size());
+        return Text::reference(std::string_view(ptr, chars.size()));
     }
 
-    //! Extract a token from the input stream.
-    Token M_getToken()
+    //! Release all the arena memory at once.
+    void release()
+    { m_resource.release(); }
+
+private:
+    std::pmr::monotonic_buffer_resource m_resource;
+};
+
+// --------------------------------------------------------------------------------------
+// Statistics
+// --------------------------------------------------------------------------------------
+
+#ifndef JSON_STATS
+# define JSON_STATS 0
+#endif
+
+//! Counters of a parse or of an extraction, only collected if JSON_STATS
+//!   is defined to 1 (so that they cost nothing otherwise).
+//! They are collected per thread, from the beginning to the end of the
+//!   outermost parse or extraction (the parse of an included file, or the
+//!   parse of a value to extract, belongs to the outer one), and are then
+//!   reported to the observer if any.
+struct Stats
+{
+    //! Where the time is spent (each phase excludes the nested ones,
+    //!   for instance the parser's time excludes the lexer's).
+    enum Phase
     {
-        // Skip whitespaces and comments
-        M_skip();
+        Lexing,
+        Parsing,
+        Extracting,
+        Including,
+        Phases
+    };
 
-        // Create token (bad by default), and save current stream information
-        Token token = Token::Bad;
-        Token::Info info = m_currentInfo;
+    //! Number of node types (see Node::Type).
+    static const int NodeTypes = 6;
 
-        // Handle EOF gracefully
-        if (m_nextChar < 0)
-            token = Token::Eof;
-        else
-        {
-            bool eatlast = true;
-
-            if (m_nextChar == '{')
-                token = Token::LeftBrace;
-            else if (m_nextChar == '}')
-                token = Token::RightBrace;
-            else if (m_nextChar == '[')
-                token = Token::LeftBracket;
-            else if (m_nextChar == ']')
-                token = Token::RightBracket;
-            else if (m_nextChar == ',')
-                token = Token::Comma;
-            else if (m_nextChar == ':')
-                token = Token::Colon;
-            else if (m_nextChar == 't')
-                token = M_matchKeyword(Token::True, "true");
-            else if (m_nextChar == 'f')
-                token = M_matchKeyword(Token::False, "false");
-            else if (m_nextChar == 'n')
-                token = M_matchKeyword(Token::Null, "null");
-            else
-            {
-                // Includes
-                if (m_nextChar == '@')
-                {
-                    M_getChar();
+    class Scope;
+    class Nesting;
 
-                    std::string path;
+    //! Get the name string of a phase.
+    static std::string phaseName(Phase phase)
+    {
+        if (phase == Lexing) return "Lexing";
+        else if (phase == Parsing) return "Parsing";
+        else if (phase == Extracting) return "Extracting";
+        else if (phase == Including) return "Including";
 
-                    bool ok = m_nextChar == '"';
-                    M_getChar();
+        return "?";
+    }
 
-                    while (ok && m_nextChar != '"')
-                    {
-                        // Stop if EOF is encountered
-                        if (m_nextChar < 0)
-                            ok = false;
+    //! Set the observer of the statistics, returning the previous one
+    //!   (statistics are not collected while there is none).
+    static StatsObserver* observe(StatsObserver* observer)
+    { return M_observer().exchange(observer, std::memory_order_acq_rel); }
 
-                        path += M_getChar();
-                    }
+    //! Get the statistics being collected on this thread, if any.
+    static Stats* current()
+    { return M_current(); }
 
-                    ok = ok && m_nextChar == '"';
+    //! Account for an allocated node.
+    template <typename N>
+    static void node(N const* node)
+    {
+#if JSON_STATS
+        if (Stats* stats = M_current())
+            ++stats->nodes[node->type()];
+#else
+        (void) node;
+#endif
+    }
 
-                    if (!ok)
-                        token = Token::Bad;
-                    else
-                        token = Token(Token::Include, path);
-                }
-                // String and identifiers
-                else if (m_nextChar == '"')
-                {
-                    // Eat the double quotes
-                    M_getChar();
+    //! Map an included file (defined below).
+    static bool include(MappedFile& map, std::string const& file);
 
-                    std::string value;
-                    bool ok = true;
+    //! Add other statistics to these ones.
+    Stats& operator+=(Stats const& other)
+    {
+        bytes += other.bytes;
+        for (int i = 0; i <= Token::Include; ++i)
+            tokens[i] += other.tokens[i];
+        for (int i = 0; i < NodeTypes; ++i)
+            nodes[i] += other.nodes[i];
+        maxDepth = std::max(maxDepth, other.maxDepth);
+        includes += other.includes;
+        for (int i = 0; i < Phases; ++i)
+            time[i] += other.time[i];
+        return *this;
+    }
 
-                    while (ok && m_nextChar != '"')
-                    {
-                        // Stop if EOF is encountered
-                        if (m_nextChar < 0)
-                            ok = false;
-
-                        // Handle some escape sequences
-                        if (m_nextChar == '\\')
-                        {
-                            // Eat the backslash
-                            M_getChar();
-
-                            // Get the escaped character (and handle EOF)
-                            int ch = M_getChar();
-                            if (ch < 0)
-                                ok = false;
-
-                            if (ch == '\\')
-                                value += '\\';
-                            else if (ch == '"')
-                                value += '"';
-                            else if (ch == 'n')
-                                value += '\n';
-                            else if (ch == 't')
-                                value += 't';
-                            else
-                                ok = false;
-                        }
-                        // Simple character
-                        else
-                            value += M_getChar();
-                    }
+public:
+    //! Characters consumed by the lexers
+    std::size_t bytes = 0;
+    //! Extracted tokens, and allocated nodes, by type
+    std::size_t tokens[Token::Include + 1] = {};
+    std::size_t nodes[NodeTypes] = {};
+    //! Maximum nesting depth of the parsed objects and arrays
+    int maxDepth = 0;
+    //! Included files that were opened
+    std::size_t includes = 0;
+    //! Time spent in each phase (added up across threads)
+    std::chrono::nanoseconds time[Phases] = {};
 
-                    // Strings must end with another double quotes
-                    ok = ok && m_nextChar == '"';
+private:
+    typedef std::chrono::steady_clock Clock;
 
-                    if (!ok)
-                        token = Token::Bad;
-                    else
-                        token = Token(Token::String, value);
-                }
-                // Numbers
-                if (m_nextChar == '-' || m_nextChar == '.' || std::isdigit(m_nextChar))
-                {
-                    std::string value;
-                    bool ok = true;
+    static std::atomic<StatsObserver*>& M_observer()
+    {
+        static std::atomic<StatsObserver*> observer(nullptr);
+        return observer;
+    }
 
-                    // Eventual sign
-                    if (m_nextChar == '-')
-                    {
-                        value += M_getChar();
-                        if (m_nextChar < 0)
-                            ok = false;
-                    }
+    static Stats*& M_current()
+    {
+        thread_local Stats* current = nullptr;
+        return current;
+    }
 
-                    // Eventual integer part
-                    while (ok && std::isdigit(m_nextChar))
-                    {
-                        value += M_getChar();
-                        if (m_nextChar < 0)
-                            ok = false;
-                    }
+    //! Charge the time since the last switch to the current phase,
+    //!   and enter the given one (returning the previous one).
+    Phase M_switch(Phase phase)
+    {
+        Clock::time_point now = Clock::now();
+        time[m_phase] += now - m_mark;
+        m_mark = now;
 
-                    // Eventual floating part
-                    if (ok && m_nextChar == '.')
-                    {
-                        // Eat the dot
-                        value += M_getChar();
-                        if (m_nextChar < 0)
-                            ok = false;
-
-                        // Don't allow empty floating parts
-                        //   (as we already allow empty integer parts, we
-                        //   would end up with '.' as a valid number...)
-                        if (!std::isdigit(m_nextChar))
-                            ok = false;
-
-                        // Get the floating part
-                        while (ok && std::isdigit(m_nextChar))
-                        {
-                            value += M_getChar();
-                            if (m_nextChar < 0)
-                                ok = false;
-                        }
-                    }
+        std::swap(phase, m_phase);
+        return phase;
+    }
 
-                    // Eventual exponent part
-                    if (ok && (m_nextChar == 'e' || m_nextChar == 'E'))
-                    {
-                        // Eat the 'e'
-                        value += M_getChar();
-                        if (m_nextChar < 0)
-                            ok = false;
-
-                        // Eventual exponent's sign
-                        if (m_nextChar == '-')
-                        {
-                            value += M_getChar();
-                            if (m_nextChar < 0)
-                                ok = false;
-                        }
-
-                        if (!std::isdigit(m_nextChar))
-                            ok = false;
-
-                        while (ok && std::isdigit(m_nextChar))
-                        {
-                            value += M_getChar();
-                            if (m_nextChar < 0)
-                                ok = false;
-                        }
-                    }
+private:
+    Phase m_phase = Parsing;
+    Clock::time_point m_mark;
+    int m_depth = 0;
+};
 
-                    if (!ok)
-                        token = Token::Bad;
-                    else
-                        token = Token(Token::Number, value);
+//! An observer of the statistics, that receives them at the end of
+//!   each outermost parse or extraction.
+//! It is called from the thread that made it (possibly concurrently
+//!   from several threads), and must not throw.
+class StatsObserver
+{
+public:
+    virtual ~StatsObserver() {}
+    virtual void report(Stats const& stats) = 0;
+};
 
-                    eatlast = false;
-                }
-            }
+//! Collect the statistics of a phase during its lifetime (reporting
+//!   them at its end if it is the outermost one).
+//! Lexing alone is not reported, as lexers are driven by the parses and
+//!   extractions (and also lex their first token when constructed).
+class Stats::Scope
+{
+public:
+    Scope(Phase phase)
+    { M_enter(phase, nullptr); }
 
-            // Get the last char from previous rules
-            if (eatlast && token.type() != Token::Bad)
-                M_getChar();
-        }
+    //! Same as above, but collect the statistics into the given ones (if
+    //!   any) rather than reporting them, for instance to merge those of
+    //!   worker threads.
+    Scope(Phase phase, Stats* into)
+    { M_enter(phase, into); }
 
-        // Set stream information for this token and return
-        token.setInfo(info);
-        return token;
+    ~Scope()
+    {
+#if JSON_STATS
+        if (!m_stats)
+            return;
+
+        m_stats->M_switch(m_previous);
+        if (m_outer)
+        {
+            M_current() = nullptr;
+            if (m_observer)
+                m_observer->report(*m_stats);
+        }
+#endif
     }
 
-    //! Match a keyword in the input stream, returning a token
-    //!   with the given type (or a Bad one in case of a mismatch).
-    Token M_matchKeyword(Token::Type type, std::string const& kw)
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+
+private:
+    void M_enter(Phase phase, Stats* into)
     {
-        for (unsigned int i = 0; i < kw.size(); ++i)
+#if JSON_STATS
+        m_stats = M_current();
+        if (m_stats)
         {
-            if (m_nextChar != kw[i])
-                return Token::Bad;
-            if (i == kw.size()-1)
-                break;
-            M_getChar();
+            m_previous = m_stats->M_switch(phase);
+            return;
         }
 
-        return type;
+        if (!into)
+        {
+            m_observer = phase == Lexing ? nullptr : M_observer().load(std::memory_order_acquire);
+            if (!m_observer)
+                return;
+
+            m_own.emplace();
+            into = &*m_own;
+        }
+
+        m_outer = true;
+        m_stats = M_current() = into;
+        m_stats->m_phase = m_previous = phase;
+        m_stats->m_mark = Clock::now();
+#else
+        (void) phase;
+        (void) into;
+#endif
     }
-    
+
+#if JSON_STATS
 private:
-    std::istream& m_in;
-    
-    int m_nextChar;
-    Token m_nextToken;
-    Token::Info m_currentInfo;
+    Stats* m_stats;
+    Phase m_previous;
+    bool m_outer = false;
+    StatsObserver* m_observer = nullptr;
+    //! The outermost scope owns the statistics, unless collected elsewhere
+    std::optional<Stats> m_own;
+#endif
+};
+
+//! Account for a parsed object or array during its lifetime.
+class Stats::Nesting
+{
+public:
+    Nesting()
+    {
+#if JSON_STATS
+        if (Stats* stats = M_current())
+            stats->maxDepth = std::max(stats->maxDepth, ++stats->m_depth);
+#endif
+    }
+
+    ~Nesting()
+    {
+#if JSON_STATS
+        if (Stats* stats = M_current())
+            --stats->m_depth;
+#endif
+    }
+
+    Nesting(Nesting const&) = delete;
+    Nesting& operator=(Nesting const&) = delete;
 };
 
+inline bool Stats::include(MappedFile& map, std::string const& file)
+{
+    Scope scope(Including);
+#if JSON_STATS
+    if (Stats* stats = M_current())
+        ++stats->includes;
+#endif
+    return map.open(file);
+}
+
 // --------------------------------------------------------------------------------------
-// Nodes
+// Includes
 // --------------------------------------------------------------------------------------
 
-class NumberNode;
-class BooleanNode;
-class StringNode;
-class ObjectNode;
-class ArrayNode;
-
-class Node
+//! An included file, entered for as long as it is read.
+//! Every way of reading includes (parsing, the resolver's cache, streaming
+//!   extraction, events and selection) enters them through this class, so
+//!   that include cycles are detected in a single place: each thread keeps
+//!   the canonical paths of the files it is including, outermost first.
+class Include
 {
-    //! Needed to access private members of *Node from
-    //!   M_serialize() and M_multiline().
-    friend class ObjectNode;
-    friend class ArrayNode;
 public:
-    enum Type
+    //! Enter an included file, throws if it doesn't exist or if it
+    //!   is already being included.
+    explicit Include(std::string const& file) :
+        m_path(canonical(file))
     {
-        Number,
-        Boolean,
-        String,
-        Object,
-        Array,
-        Null
-    };
-    
-protected:
-    Node(Token const& token = Token()) : m_token(token) {}
-    
-public:
-    virtual ~Node() {}
-    
-    //! Get the type of this node.
-    virtual Type type() const = 0;
-
-    //! Get the type string of this node.
-    static std::string typeName(Type type)
-    {
-        if (type == Number) return "Number";
-        else if (type == Boolean) return "Boolean";
-        else if (type == String) return "String";
-        else if (type == Object) return "Object";
-        else if (type == Array) return "Array";
-        else if (type == Null) return "Null";
-        
-        return "?";
+        std::vector<std::string>& files = M_files();
+        if (std::find(files.begin(), files.end(), m_path) != files.end())
+            throw std::runtime_error("json::parse: include cycle on \"" + m_path + "\"");
+        files.push_back(m_path);
     }
 
-    //! Serialize the JSON tree whose root is this node to the
-    //!   given output stream.
-    //! If indent == false, no indentation is outputted
-    //!   (and you get a compact, single-line output).
-    void serialize(std::ostream& out, bool indent = true) const
-    { M_serialize(out, 0, indent); }
-    
-    template <typename T>
-    T* downcast()
-    { return M_downcast((T*) 0); }
+    ~Include()
+    { M_files().pop_back(); }
 
-    Token const& token() const
-    { return m_token; }
-    
-protected:
-    virtual void M_serialize(std::ostream& out, int level, bool indent) const = 0;
-    virtual bool M_multiline() const = 0;
-    
-    template <typename T>
-    T* M_downcast(T*)
-    { return 0; }
-    
-    NumberNode* M_downcast(NumberNode*)
-    { return M_safeCast<Number, NumberNode>(); }
-    
-    BooleanNode* M_downcast(BooleanNode*)
-    { return M_safeCast<Boolean, BooleanNode>(); }
-    
-    StringNode* M_downcast(StringNode*)
-    { return M_safeCast<String, StringNode>(); }
-    
-    ObjectNode* M_downcast(ObjectNode*)
-    { return M_safeCast<Object, ObjectNode>(); }
-    
-    ArrayNode* M_downcast(ArrayNode*)
-    { return M_safeCast<Array, ArrayNode>(); }
-    
-    template <Type tp, typename T>
-    T* M_safeCast()
-    {
-        if (type() != tp) return 0;
-        return (T*) this;
-    }
+    Include(Include const&) = delete;
+    Include& operator=(Include const&) = delete;
 
-private:
-    Token m_token;
-};
+    std::string const& path() const
+    { return m_path; }
 
-class NumberNode : public Node
-{
-public:
-    NumberNode(float value, Token const& token = Token()) : Node(token), m_value(value) {}
-    
-    Type type() const { return Number; }
-    float value() const { return m_value; }
-    
-private:
-    void M_serialize(std::ostream& out, int level, bool indent) const
+    //! Map the file to lex it (the mapping lives as long as this object).
+    MappedFile const& map()
     {
-        std::string pre = "";
-        for (int i = 0; indent && i < level; ++i) pre += " ";
-        
-        out << pre << m_value;
+        if (!Stats::include(m_map, m_path))
+            throw std::runtime_error("json::parse: unable to open \"" + m_path + "\"");
+        return m_map;
     }
 
-    bool M_multiline() const { return false; }
-    
-private:
-    float m_value;
-};
+    //! Get the canonical path of a file, throws if it doesn't exist.
+    static std::string canonical(std::string const& file)
+    {
+        std::error_code ec;
+        std::filesystem::path path = std::filesystem::canonical(file, ec);
+        if (ec)
+            throw std::runtime_error("json::parse: unable to open \"" + file + "\"");
+        return path.string();
+    }
 
-class BooleanNode : public Node
-{
-public:
-    BooleanNode(bool value, Token const& token = Token()) : Node(token), m_value(value) {}
-    
-    Type type() const { return Boolean; }
-    bool value() const { return m_value; }
-    
 private:
-    void M_serialize(std::ostream& out, int level, bool indent) const
+    static std::vector<std::string>& M_files()
     {
-        std::string pre = "";
-        for (int i = 0; indent && i < level; ++i) pre += " ";
-        
-        out << pre << (m_value ? "true" : "false");
+        thread_local std::vector<std::string> files;
+        return files;
     }
 
-    bool M_multiline() const { return false; }
-    
 private:
-    bool m_value;
+    std::string m_path;
+    MappedFile m_map;
 };
 
-class StringNode : public Node
+// --------------------------------------------------------------------------------------
+// Lexer
+// --------------------------------------------------------------------------------------
+
+#ifndef JSON_LEXER_BLOCK_SIZE
+# define JSON_LEXER_BLOCK_SIZE 65536
+#endif
+
+//! The lexer works on a contiguous range of characters, scanned with
+//!   plain pointer arithmetic.
+//! It either lexes a whole buffer provided by the caller, or it fills
+//!   a block buffer from an input stream each time the current block
+//!   is exhausted.
+class Lexer
 {
 public:
-    StringNode(std::string const& value, Token const& token = Token()) : Node(token), m_value(value) {}
-    
-    Type type() const { return String; }
-    std::string const& value() const { return m_value; }
+    //! Lex an input stream, read by blocks of JSON_LEXER_BLOCK_SIZE
+    //!   characters.
+    //! If records == true, the stream is a sequence of values (such as
+    //!   newline-delimited documents) and the lexer never looks ahead past
+    //!   the end of a top-level value, so that it doesn't wait for the next
+    //!   one before it is asked for.
+    Lexer(std::istream& in, bool records = false) :
+        m_in(&in),
+        m_block(new char[JSON_LEXER_BLOCK_SIZE]),
+        m_views(false),
+        m_records(records)
+    { M_init(nullptr, 0); }
+
+    //! Lex a contiguous buffer (a string, a preloaded or
+    //!   a memory-mapped file...), that must outlive the lexer.
+    //! If views == true, the values of the tokens refer to the buffer
+    //!   instead of copying it (except for strings with escape sequences),
+    //!   making it also outlive the tokens.
+    Lexer(const char* data, std::size_t size, bool views = false) :
+        m_in(nullptr),
+        m_views(views),
+        m_records(false)
+    { M_init(data, size); }
+
+    //! Lex a part of a larger buffer, that begins at the given position
+    //!   in it (token positions are then those in the larger buffer).
+    Lexer(const char* data, std::size_t size, bool views, Token::Info const& at) :
+        m_in(nullptr),
+        m_views(views),
+        m_records(false)
+    { M_init(data, size, at.line, at.offset, at.offset - (at.column - 1)); }
 
-    std::string escapedValue() const
+    ~Lexer()
+    {}
+
+    //! Get the next token from the input stream.
+    Token get()
     {
-        std::string escaped;
+        seek();
+        Token tok = std::move(m_nextToken);
+
+        // The next token is only lexed when it is looked at, so that
+        //   records aren't waited for before they are asked for, and
+        //   strings may be streamed (see stream())
+        m_pending = true;
+        M_count(tok.type());
+        return tok;
+    }
 
-        for (auto c : m_value)
+    //! Seek for the next token in the input stream
+    //!   (but do NOT extract it).
+    Token const& seek()
+    {
+        if (m_pending)
         {
-            if (c == '\n')
-                escaped += "\\n";
-            else if (c == '\t')
-                escaped += "\\t";
-            else if (c == '"')
-                escaped += "\\\"";
-            else
-                escaped += c;
+            m_nextToken = M_getToken();
+            m_pending = false;
         }
 
-        return escaped;
-    }
-    
-private:
-    void M_serialize(std::ostream& out, int level, bool indent) const
-    {
-        std::string pre = "";
-        for (int i = 0; indent && i < level; ++i) pre += " ";
-        
-        out << pre << '"' << escapedValue() << '"';
+        return m_nextToken;
     }
 
-    bool M_multiline() const { return false; }
-    
-private:
-    std::string m_value;
-};
+    //! Skip the next value, only counting its brackets and braces
+    //!   rather than lexing its tokens (so its syntax is not checked).
+    void skip()
+    {
+        Token::Type type = seek().type();
+        if (type != Token::LeftBrace && type != Token::LeftBracket)
+        {
+            get();
+            return;
+        }
 
-class ObjectNode : public Node
-{
-public:
-    ObjectNode(Token const& token = Token()) : Node(token) {}
+        Stats::Scope scope(Stats::Lexing);
 
-    ~ObjectNode()
-    {
-        for (std::map<std::string, Node*>::iterator it = m_impl.begin();
-             it != m_impl.end(); ++it)
-             delete it->second;
-    }
-    
-    Type type() const { return Object; }
-    bool exists(std::string const& key) { return m_impl.find(key) != m_impl.end(); }
-    Node*& get(std::string const& key) { return m_impl[key]; }
-    Node* get(std::string const& key) const { return m_impl.at(key); }
-    std::map<std::string, Node*>& impl() { return m_impl; }
-    std::map<std::string, Node*> const& impl() const { return m_impl; }
-    
-private:
-    void M_serialize(std::ostream& out, int level, bool indent) const
-    {
-        std::string pre = "";
-        for (int i = 0; indent && i < level; ++i) pre += " ";
-        
-        out << pre << '{';
-        if (indent) out << std::endl;
-        
-        std::map<std::string, Node*>::const_iterator it;
-        for (it = m_impl.begin(); it != m_impl.end(); ++it)
+        // The opening brace or bracket is already extracted
+        for (int depth = 1; depth > 0;)
         {
-            if (indent) out << pre << "    ";
-            out << '"' << it->first << "\": ";
-            
-            if (indent && it->second->M_multiline())
+            int ch = M_peek();
+            if (ch < 0)
+                break;
+            ++m_cur;
+
+            if (ch == '{' || ch == '[')
+                ++depth;
+            else if (ch == '}' || ch == ']')
+                --depth;
+            else if (ch == '"')
+                M_skipString(true);
+            else if (ch == '@' && M_peek() == '"')
             {
-                out << std::endl;
-                it->second->M_serialize(out, level + 4, indent);
+                ++m_cur;
+                M_skipString(false);
             }
-            else
+            else if (ch == '#')
             {
-                it->second->M_serialize(out, 0, false);
+                --m_cur;
+                M_skipComments();
             }
-            
-            // (++it)-- returns the next iterator value, leaving
-            //   it unchanged.
-            if ((++it)-- != m_impl.end())
-                out << ", ";
-            if (indent) out << std::endl;
         }
-        
-        out << pre << '}';
+
+        m_pending = true;
+        M_count(type);
     }
 
-    bool M_multiline() const { return true; }
-    
-private:
-    std::map<std::string, Node*> m_impl;
-};
+    //! Extract the next token if it is a string that is not lexed yet,
+    //!   passing its characters to out(std::string_view) by chunks
+    //!   rather than accumulating them, and return true.
+    //! The token is set (without value) before the first chunk, and is
+    //!   a Bad one afterwards if the string is not terminated.
+    //! Otherwise, return false and leave the next token to get().
+    template <typename F>
+    bool stream(Token& token, F const& out)
+    {
+        if (!m_pending)
+            return false;
 
-class ArrayNode : public Node
-{
-public:
-    ArrayNode(Token const& token = Token()) : Node(token) {}
+        Token::Info info;
+        {
+            Stats::Scope scope(Stats::Lexing);
+            M_skip();
+            if (M_peek() != '"')
+                return false;
 
-    ~ArrayNode()
-    {
-        for (unsigned int i = 0; i < m_impl.size(); ++i)
-            delete m_impl[i];
-    }
-    
-    Type type() const { return Array; }
-    size_t size() const { return m_impl.size(); }
-    Node*& at(size_t i)
-    {
-        if (i >= m_impl.size()) throw std::domain_error("json::ArrayNode::at: index out of bounds");
-        return m_impl[i];
-    }
+            info = M_info();
+            ++m_cur;
+        }
 
-    Node* at(size_t i) const
-    {
-        if (i >= m_impl.size()) throw std::domain_error("json::ArrayNode::at: index out of bounds");
-        return m_impl[i];
-    }
+        token = Token::String;
+        token.setInfo(info);
 
-    std::vector<Node*>& impl() { return m_impl; }
-    std::vector<Node*> const& impl() const { return m_impl; }
-    
-private:
-    void M_serialize(std::ostream& out, int level, bool indent) const
-    {
-        std::string pre = "";
-        for (int i = 0; indent && i < level; ++i) pre += " ";
-        
-        out << pre << '[';
-        bool multi = indent && M_multiline();
-        if (multi) out << std::endl;
-        
-        for (unsigned int i = 0; i < m_impl.size(); ++i)
+        for (;;)
         {
-            if (multi)
+            // Pass the characters up to the closing double quotes (or
+            //   the next escape sequence), block by block
+            const char* p = M_scanString(m_cur, m_end, true);
+            if (p != m_cur)
+                out(std::string_view(m_cur, p - m_cur));
+            m_cur = p;
+
+            if (p == m_end)
             {
-                m_impl[i]->M_serialize(out, level + 4, indent);
+                if (M_refill())
+                    continue;
+                break;
             }
-            else
+
+            if (*m_cur++ == '"')
             {
-                m_impl[i]->M_serialize(out, 0, false);
+                M_count(Token::String);
+                return true;
             }
-            
-            if (i != m_impl.size()-1)
-                out << ", ";
-            if (multi) out << std::endl;
+
+            int ch = M_escape(M_peek());
+            if (ch < 0)
+                break;
+
+            char escaped = static_cast<char>(ch);
+            out(std::string_view(&escaped, 1));
+            ++m_cur;
         }
-        
-        out << pre << ']';
-    }
 
-    bool M_multiline() const
-    {
-        for (unsigned int i = 0; i < m_impl.size(); ++i)
-            if (m_impl[i]->M_multiline())
-                return true;
-        return false;
+        token = Token::Bad;
+        token.setInfo(info);
+        return true;
     }
-    
-private:
-    std::vector<Node*> m_impl;
-};
 
-class NullNode : public Node
-{
-public:
-    NullNode(Token const& token = Token()) : Node(token) {}
-    
-    Type type() const { return Null; }
-    
 private:
-    void M_serialize(std::ostream& out, int level, bool indent) const
+    //! Init the lexer (called from constructors).
+    void M_init(const char* data, std::size_t size, int line = 1,
+                std::size_t base = 0, std::size_t lineStart = 0)
     {
-        std::string pre = "";
-        for (int i = 0; indent && i < level; ++i) pre += " ";
+        m_begin = m_cur = m_lines = data;
+        m_end = data + size;
+        m_mark = nullptr;
+        m_base = base;
+
+        m_line = line;
+        m_lineStart = lineStart;
+        m_counted = base;
+
+        // Get first token (m_nextToken is now valid), unless lexing records
+        //   that may not be available yet
+        m_pending = m_records;
+        if (!m_pending)
+            m_nextToken = M_getToken();
+    }
 
-        out << pre << "null";
+    //! Account for an extracted token (only the opening one for skipped
+    //!   values), and for the characters consumed since the last one.
+    void M_count(Token::Type type)
+    {
+#if JSON_STATS
+        std::size_t offset = M_offset(m_cur);
+        if (Stats* stats = Stats::current())
+        {
+            ++stats->tokens[type];
+            stats->bytes += offset - m_counted;
+        }
+        m_counted = offset;
+#else
+        (void) type;
+#endif
     }
 
-    bool M_multiline() const { return false; }
-    
-private:
-};
+    static bool M_isSpace(int ch)
+    { return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\f'; }
 
-// --------------------------------------------------------------------------------------
-// Parser
-// --------------------------------------------------------------------------------------
+    static bool M_isDigit(int ch)
+    { return ch >= '0' && ch <= '9'; }
 
-class Parser
-{
-public:
-    Parser(Lexer& lex) : m_lex(lex) {}
-    ~Parser() {}
-    
-    Node* parse()
+    //! Find the first non-whitespace character in [p, end) (or end).
+    //! Whitespaces are checked by blocks of 16 or 32 characters when
+    //!   SIMD instructions are available (disabled with JSON_NO_SIMD).
+    static const char* M_scanSpaces(const char* p, const char* end)
     {
-        if (m_lex.seek().type() == Token::LeftBrace)
-            return M_object();
+        // Runs of whitespaces between tokens are often a single space
+        if (p == end || !M_isSpace(*p) || ++p == end || !M_isSpace(*p))
+            return p;
 
-        return M_array();
-    }
-    
-private:
-    Node* M_atom()
-    {
-        Token next = m_lex.seek();
-        if (next.type() == Token::Bad)
+#if defined(JSON_HAS_AVX2)
+        for (; end - p >= 32; p += 32)
         {
-            throw TokenError(next, "bad token");
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i c = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+            __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                         _mm256_cmpeq_epi8(_mm256_min_epu8(c, _mm256_set1_epi8(4)), c));
+            uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(ws));
+            if (mask)
+                return p + __builtin_ctz(mask);
         }
-        else if (next.type() == Token::True ||
-                 next.type() == Token::False)
+#elif defined(JSON_HAS_SSE2)
+        for (; end - p >= 16; p += 16)
         {
-            m_lex.get();
-            return new BooleanNode(next.type() == Token::True, next);
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i c = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+            __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                      _mm_cmpeq_epi8(_mm_min_epu8(c, _mm_set1_epi8(4)), c));
+            uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_epi8(ws)) & 0xFFFF;
+            if (mask)
+                return p + __builtin_ctz(mask);
         }
-        else if (next.type() == Token::Null)
+#elif defined(JSON_HAS_NEON)
+        for (; end - p >= 16; p += 16)
         {
-            m_lex.get();
-            return new NullNode(next);
+            uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+            uint8x16_t ws = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')),
+                                     vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8(4)));
+            uint64_t mask = ~M_neonMask(ws);
+            if (mask)
+                return p + __builtin_ctzll(mask) / 4;
         }
-        else if (next.type() == Token::Number)
+#endif
+
+        while (p != end && M_isSpace(*p))
+            ++p;
+        return p;
+    }
+
+    //! Find the first double quotes (or backslash, if escapes is true)
+    //!   in [p, end) (or end).
+    static const char* M_scanString(const char* p, const char* end, bool escapes)
+    {
+        if (!escapes)
         {
-            m_lex.get();
-            
-            float value;
-            try {
-                value = std::stof(next.value());
-            } catch (std::exception const&) {
-                value = 0.0f;
-            }
+            const char* q = static_cast<const char*>(std::memchr(p, '"', end - p));
+            return q ? q : end;
+        }
 
-            return new NumberNode(value, next);
+#if defined(JSON_HAS_AVX2)
+        for (; end - p >= 32; p += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(stop));
+            if (mask)
+                return p + __builtin_ctz(mask);
         }
-        else if (next.type() == Token::String)
+#elif defined(JSON_HAS_SSE2)
+        for (; end - p >= 16; p += 16)
         {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                        _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(stop));
+            if (mask)
+                return p + __builtin_ctz(mask);
+        }
+#elif defined(JSON_HAS_NEON)
+        for (; end - p >= 16; p += 16)
+        {
+            uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+            uint8x16_t stop = vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\')));
+            uint64_t mask = M_neonMask(stop);
+            if (mask)
+                return p + __builtin_ctzll(mask) / 4;
+        }
+#endif
+
+        while (p != end && *p != '"' && *p != '\\')
+            ++p;
+        return p;
+    }
+
+#if defined(JSON_HAS_NEON)
+    //! Narrow a comparison result to 4 bits per character.
+    static uint64_t M_neonMask(uint8x16_t cmp)
+    { return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4)), 0); }
+#endif
+
+    //! Get the absolute input offset of a position in the current block.
+    std::size_t M_offset(const char* at) const
+    { return m_base + (at - m_begin); }
+
+    //! Get the next character, without extracting it
+    //!   (returns -1 at the end of the input).
+    int M_peek()
+    {
+        if (m_cur == m_end && !M_refill())
+            return -1;
+        return static_cast<unsigned char>(*m_cur);
+    }
+
+    //! Replace the current block by the next one from the input stream.
+    //! Characters that are still marked are saved beforehand, so
+    //!   that tokens may span several blocks.
+    bool M_refill()
+    {
+        if (!m_in || !m_in->good())
+            return false;
+
+        M_countLines(m_end);
+        if (m_mark)
+            m_carry.append(m_mark, m_end);
+        m_base += m_end - m_begin;
+
+        // Don't wait for a whole block, but only for what the stream
+        //   can give without blocking (at least one character)
+        std::streambuf* buf = m_in->rdbuf();
+        std::streamsize n = 0;
+        if (buf)
+        {
+            std::streamsize avail = buf->in_avail();
+            if (avail <= 0)
+            {
+                int ch = buf->sbumpc();
+                if (ch != std::char_traits<char>::eof())
+                {
+                    m_block[n++] = static_cast<char>(ch);
+                    avail = buf->in_avail();
+                }
+            }
+
+            if (avail > 0)
+                n += buf->sgetn(m_block.get() + n, std::min<std::streamsize>(avail, JSON_LEXER_BLOCK_SIZE - n));
+        }
+
+        if (n == 0)
+            m_in->setstate(std::ios::eofbit);
+
+        m_begin = m_cur = m_lines = m_block.get();
+        m_end = m_begin + n;
+        if (m_mark)
+            m_mark = m_begin;
+
+        return n > 0;
+    }
+
+    //! Start recording the extracted characters.
+    void M_mark()
+    {
+        m_mark = m_cur;
+        m_carry.clear();
+    }
+
+    //! Stop recording, appending the extracted characters to out.
+    void M_unmark(std::string& out)
+    {
+        out.append(m_carry);
+        out.append(m_mark, m_cur);
+        m_mark = nullptr;
+    }
+
+    //! Stop recording, getting the extracted characters (directly
+    //!   from the buffer when views are enabled).
+    Text M_unmark()
+    {
+        if (m_views)
+        {
+            Text text = Text::reference(std::string_view(m_mark, m_cur - m_mark));
+            m_mark = nullptr;
+            return text;
+        }
+
+        // Copy the characters only once when they all are in this block
+        if (m_carry.empty())
+        {
+            Text text(std::string_view(m_mark, m_cur - m_mark));
+            m_mark = nullptr;
+            return text;
+        }
+
+        std::string str;
+        M_unmark(str);
+        return str;
+    }
+
+    //! Account for the new lines up to the given position
+    //!   in the current block.
+    //! This is done in bulk when a token is created rather than
+    //!   for each extracted character.
+    void M_countLines(const char* to)
+    {
+        while (m_lines < to)
+        {
+            const char* nl = static_cast<const char*>(std::memchr(m_lines, '\n', to - m_lines));
+            if (!nl)
+            {
+                m_lines = to;
+                break;
+            }
+
+            ++m_line;
+            m_lines = nl + 1;
+            m_lineStart = M_offset(m_lines);
+        }
+    }
+
+    //! Get the stream information for the current position.
+    Token::Info M_info()
+    {
+        M_countLines(m_cur);
+
+        Token::Info info;
+        info.empty = false;
+        info.offset = M_offset(m_cur);
+        info.line = m_line;
+        info.column = static_cast<int>(info.offset - m_lineStart) + 1;
+        return info;
+    }
+
+    //! Skip whitespaces (and new lines).
+    void M_skipWs()
+    {
+        for (;;)
+        {
+            m_cur = M_scanSpaces(m_cur, m_end);
+
+            if (m_cur != m_end || !M_refill())
+                return;
+        }
+    }
+
+    //! Skip comments, starting with a hashtag '#'.
+    void M_skipComments()
+    {
+        while (M_peek() == '#')
+        {
+            for (;;)
+            {
+                const char* nl = static_cast<const char*>(std::memchr(m_cur, '\n', m_end - m_cur));
+                if (nl)
+                {
+                    m_cur = nl;
+                    break;
+                }
+
+                m_cur = m_end;
+                if (!M_refill())
+                    return;
+            }
+
+            M_skipWs();
+        }
+    }
+
+    //! Skip the rest of a string, up to (and including) its closing
+    //!   double quotes.
+    void M_skipString(bool escapes)
+    {
+        for (;;)
+        {
+            m_cur = M_scanString(m_cur, m_end, escapes);
+            if (m_cur == m_end)
+            {
+                if (!M_refill())
+                    return;
+                continue;
+            }
+
+            if (*m_cur++ == '"')
+                return;
+
+            // Skip the escaped character
+            if (M_peek() < 0)
+                return;
+            ++m_cur;
+        }
+    }
+
+    //! Skip whitespaces and comments.
+    void M_skip()
+    {
+        M_skipWs();
+        M_skipComments();
+        M_skipWs();
+    }
+
+    //! Extract a token from the input stream.
+    Token M_getToken()
+    {
+        Stats::Scope scope(Stats::Lexing);
+
+        // Skip whitespaces and comments
+        M_skip();
+
+        // Create token (bad by default), and save current stream information
+        Token token = Token::Bad;
+        Token::Info info = M_info();
+
+        int ch = M_peek();
+
+        // Handle EOF gracefully
+        if (ch < 0)
+            token = Token::Eof;
+        else if (ch == '{')
+            token = M_single(Token::LeftBrace);
+        else if (ch == '}')
+            token = M_single(Token::RightBrace);
+        else if (ch == '[')
+            token = M_single(Token::LeftBracket);
+        else if (ch == ']')
+            token = M_single(Token::RightBracket);
+        else if (ch == ',')
+            token = M_single(Token::Comma);
+        else if (ch == ':')
+            token = M_single(Token::Colon);
+        else if (ch == 't')
+            token = M_matchKeyword(Token::True, "true");
+        else if (ch == 'f')
+            token = M_matchKeyword(Token::False, "false");
+        else if (ch == 'n')
+            token = M_matchKeyword(Token::Null, "null");
+        // Includes
+        else if (ch == '@')
+        {
+            // Eat the '@'
+            ++m_cur;
+
+            if (M_peek() == '"')
+            {
+                // Eat the double quotes
+                ++m_cur;
+
+                Text path;
+                if (M_string(path, false))
+                    token = Token(Token::Include, std::move(path));
+            }
+        }
+        // String and identifiers
+        else if (ch == '"')
+        {
+            // Eat the double quotes
+            ++m_cur;
+            Text value;
+            if (M_string(value, true))
+                token = Token(Token::String, std::move(value));
+        }
+        // Numbers
+        else if (ch == '-' || ch == '.' || M_isDigit(ch))
+            token = M_number();
+
+        // Set stream information for this token and return
+        token.setInfo(info);
+        return token;
+    }
+
+    //! Extract a single-character token.
+    Token M_single(Token::Type type)
+    {
+        ++m_cur;
+        return type;
+    }
+
+    //! Match a keyword in the input stream, returning a token
+    //!   with the given type (or a Bad one in case of a mismatch).
+    Token M_matchKeyword(Token::Type type, const char* kw)
+    {
+        for (; *kw; ++kw)
+        {
+            if (M_peek() != *kw)
+                return Token::Bad;
+            ++m_cur;
+        }
+
+        return type;
+    }
+
+    //! Get the character of an escape sequence (or -1 if it isn't
+    //!   supported).
+    static int M_escape(int ch)
+    {
+        if (ch == '\\' || ch == '"')
+            return ch;
+        else if (ch == 'n')
+            return '\n';
+        else if (ch == 't')
+            return '\t';
+        return -1;
+    }
+
+    //! Extract the rest of a string, up to (and including) its
+    //!   closing double quotes.
+    //! Clean spans between escape sequences are appended in one step,
+    //!   and strings without any are not copied at all when views are enabled.
+    bool M_string(Text& text, bool escapes)
+    {
+        std::string value;
+        bool escaped = false;
+        M_mark();
+
+        for (;;)
+        {
+            // Find the closing double quotes (or the next escape sequence)
+            const char* p = M_scanString(m_cur, m_end, escapes);
+            m_cur = p;
+
+            // Stop if EOF is encountered
+            if (p == m_end)
+            {
+                if (M_refill())
+                    continue;
+
+                m_mark = nullptr;
+                return false;
+            }
+
+            // Strings must end with another double quotes
+            if (*m_cur == '"' && !escaped)
+            {
+                text = M_unmark();
+                ++m_cur;
+                return true;
+            }
+
+            M_unmark(value);
+            if (*m_cur++ == '"')
+            {
+                text = std::move(value);
+                return true;
+            }
+
+            // Handle some escape sequences
+            int ch = M_escape(M_peek());
+            if (ch < 0)
+                return false;
+
+            value += static_cast<char>(ch);
+            ++m_cur;
+            escaped = true;
+            M_mark();
+        }
+    }
+
+    //! Extract a run of digits.
+    void M_digits()
+    {
+        for (;;)
+        {
+            while (m_cur != m_end && M_isDigit(*m_cur))
+                ++m_cur;
+
+            if (m_cur != m_end || !M_refill())
+                return;
+        }
+    }
+
+    //! Extract a number (integral ones are flagged, so that they can
+    //!   be converted exactly).
+    Token M_number()
+    {
+        bool ok = true;
+        unsigned flags = Token::Integral;
+        M_mark();
+
+        // Eventual sign
+        if (M_peek() == '-')
+        {
+            ++m_cur;
+            flags |= Token::Negative;
+        }
+
+        // Eventual integer part
+        bool integer = M_isDigit(M_peek());
+        M_digits();
+
+        // Eventual floating part
+        if (M_peek() == '.')
+        {
+            // Eat the dot
+            ++m_cur;
+            flags &= ~Token::Integral;
+
+            // Don't allow empty floating parts
+            //   (as we already allow empty integer parts, we
+            //   would end up with '.' as a valid number...)
+            if (!M_isDigit(M_peek()))
+                ok = false;
+
+            // Get the floating part
+            M_digits();
+        }
+        else if (!integer)
+            ok = false;
+
+        // Eventual exponent part
+        if (ok && (M_peek() == 'e' || M_peek() == 'E'))
+        {
+            // Eat the 'e'
+            ++m_cur;
+            flags &= ~Token::Integral;
+
+            // Eventual exponent's sign
+            if (M_peek() == '-' || M_peek() == '+')
+                ++m_cur;
+
+            if (!M_isDigit(M_peek()))
+                ok = false;
+
+            M_digits();
+        }
+
+        Text value = M_unmark();
+
+        if (!ok)
+            return Token::Bad;
+        return Token(Token::Number, std::move(value), flags);
+    }
+
+private:
+    std::istream* m_in;
+    std::unique_ptr<char[]> m_block;
+    bool m_views;
+
+    //! Current block, and current position in it
+    const char* m_begin;
+    const char* m_cur;
+    const char* m_end;
+    //! Absolute input offset of the current block
+    std::size_t m_base;
+
+    //! Start of the recorded characters (if any), and those
+    //!   saved from previous blocks
+    const char* m_mark;
+    std::string m_carry;
+
+    //! New lines are counted up to m_lines
+    const char* m_lines;
+    int m_line;
+    std::size_t m_lineStart;
+
+    //! Records mode (the first token isn't lexed upfront), and whether
+    //!   the next token is still to be lexed
+    bool m_records;
+    bool m_pending;
+
+    //! Input offset up to which the consumed characters were counted
+    std::size_t m_counted;
+
+    Token m_nextToken;
+};
+
+// --------------------------------------------------------------------------------------
+// Codecs
+// --------------------------------------------------------------------------------------
+
+//! Hexadecimal codec for binary data (two digits per byte, that
+//!   are written in lower case).
+struct Hex
+{
+    //! Bytes are encoded by groups of groupBytes, to groupChars characters.
+    static constexpr std::size_t groupBytes = 1;
+    static constexpr std::size_t groupChars = 2;
+
+    //! Get the size of an encoded buffer.
+    static std::size_t encodedSize(std::size_t size)
+    { return 2 * size; }
+
+    //! Get the size of a decoded text (rounded down), returns false
+    //!   if this size isn't valid.
+    static bool decodedSize(std::string_view text, std::size_t& size)
+    {
+        size = text.size() / 2;
+        return text.size() % 2 == 0;
+    }
+
+    //! Encode a buffer to encodedSize(size) characters.
+    static void encode(const void* data, std::size_t size, char* out)
+    {
+        static const char digits[] = "0123456789abcdef";
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            *out++ = digits[bytes[i] >> 4];
+            *out++ = digits[bytes[i] & 0xF];
+        }
+    }
+
+    //! Decode a text to its decodedSize() bytes, returns false
+    //!   if it contains invalid characters.
+    static bool decode(std::string_view text, void* data)
+    {
+        uint8_t* out = static_cast<uint8_t*>(data);
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(text.data());
+
+        int bad = 0;
+        for (std::size_t i = 0; i + 1 < text.size(); i += 2)
+        {
+            int hi = M_value(in[i]);
+            int lo = M_value(in[i + 1]);
+            bad |= hi | lo;
+            *out++ = static_cast<uint8_t>(((hi & 0xF) << 4) | (lo & 0xF));
+        }
+
+        return bad >= 0;
+    }
+
+private:
+    //! Values of the digits (-1 for other characters).
+    struct Table
+    {
+        constexpr Table() : values()
+        {
+            for (int i = 0; i < 256; ++i)
+                values[i] = -1;
+            for (int i = 0; i < 10; ++i)
+                values['0' + i] = static_cast<signed char>(i);
+            for (int i = 0; i < 6; ++i)
+                values['a' + i] = values['A' + i] = static_cast<signed char>(10 + i);
+        }
+
+        signed char values[256];
+    };
+
+    static int M_value(uint8_t ch)
+    {
+        static constexpr Table table;
+        return table.values[ch];
+    }
+};
+
+//! Base64 codec for binary data (RFC 4648, with padding), that
+//!   is a third smaller than hex.
+struct Base64
+{
+    static constexpr std::size_t groupBytes = 3;
+    static constexpr std::size_t groupChars = 4;
+
+    static std::size_t encodedSize(std::size_t size)
+    { return 4 * ((size + 2) / 3); }
+
+    static bool decodedSize(std::string_view text, std::size_t& size)
+    {
+        std::size_t pad = 0;
+        if (text.size() >= 4 && text.size() % 4 == 0)
+            pad = (text.back() == '=') + (text[text.size() - 2] == '=');
+
+        size = text.size() / 4 * 3 - pad;
+        return text.size() % 4 == 0;
+    }
+
+    static void encode(const void* data, std::size_t size, char* out)
+    {
+        const uint8_t* in = static_cast<const uint8_t*>(data);
+
+        std::size_t i = 0;
+        for (; i + 3 <= size; i += 3)
+        {
+            uint32_t group = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+            *out++ = alphabet[(group >> 18) & 0x3F];
+            *out++ = alphabet[(group >> 12) & 0x3F];
+            *out++ = alphabet[(group >> 6) & 0x3F];
+            *out++ = alphabet[group & 0x3F];
+        }
+
+        if (i < size)
+        {
+            uint32_t group = in[i] << 16;
+            if (i + 1 < size)
+                group |= in[i + 1] << 8;
+
+            *out++ = alphabet[(group >> 18) & 0x3F];
+            *out++ = alphabet[(group >> 12) & 0x3F];
+            *out++ = i + 1 < size ? alphabet[(group >> 6) & 0x3F] : '=';
+            *out++ = '=';
+        }
+    }
+
+    static bool decode(std::string_view text, void* data)
+    {
+        std::size_t size;
+        if (!decodedSize(text, size))
+            return false;
+
+        uint8_t* out = static_cast<uint8_t*>(data);
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(text.data());
+
+        // Padding is only allowed in the last group
+        std::size_t pad = text.size() / 4 * 3 - size;
+        std::size_t last = text.size() - (pad ? 4 : 0);
+
+        int bad = 0;
+        for (std::size_t i = 0; i < last; i += 4)
+        {
+            int a = M_value(in[i]), b = M_value(in[i + 1]);
+            int c = M_value(in[i + 2]), d = M_value(in[i + 3]);
+            bad |= a | b | c | d;
+
+            uint32_t group = ((a & 0x3F) << 18) | ((b & 0x3F) << 12) | ((c & 0x3F) << 6) | (d & 0x3F);
+            *out++ = static_cast<uint8_t>(group >> 16);
+            *out++ = static_cast<uint8_t>(group >> 8);
+            *out++ = static_cast<uint8_t>(group);
+        }
+
+        if (pad)
+        {
+            int a = M_value(in[last]), b = M_value(in[last + 1]);
+            int c = pad == 1 ? M_value(in[last + 2]) : 0;
+            bad |= a | b | c;
+
+            uint32_t group = ((a & 0x3F) << 18) | ((b & 0x3F) << 12) | ((c & 0x3F) << 6);
+            *out++ = static_cast<uint8_t>(group >> 16);
+            if (pad == 1)
+                *out++ = static_cast<uint8_t>(group >> 8);
+        }
+
+        return bad >= 0;
+    }
+
+private:
+    static constexpr const char* alphabet =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    //! Values of the alphabet's characters (-1 for other characters).
+    struct Table
+    {
+        constexpr Table() : values()
+        {
+            for (int i = 0; i < 256; ++i)
+                values[i] = -1;
+            for (int i = 0; i < 64; ++i)
+                values[static_cast<unsigned char>(alphabet[i])] = static_cast<signed char>(i);
+        }
+
+        signed char values[256];
+    };
+
+    static int M_value(uint8_t ch)
+    {
+        static constexpr Table table;
+        return table.values[ch];
+    }
+};
+
+//! Incremental decoder for the codec C, that is fed with a text by chunks
+//!   of any size (a group split between two chunks is kept aside until it
+//!   is complete).
+template <typename C>
+class Decoder
+{
+public:
+    Decoder() : m_pending(0), m_bad(false), m_padded(false) {}
+
+    //! Get the maximum number of bytes decoded from a chunk.
+    static std::size_t capacity(std::size_t size)
+    { return (size + C::groupChars - 1) / C::groupChars * C::groupBytes; }
+
+    //! Decode a chunk to out (that must hold capacity(chunk.size()) bytes),
+    //!   returning the number of decoded bytes.
+    std::size_t decode(std::string_view chunk, void* out)
+    {
+        uint8_t* begin = static_cast<uint8_t*>(out);
+        uint8_t* at = begin;
+
+        // Complete the pending group first
+        if (m_pending)
+        {
+            std::size_t n = std::min(chunk.size(), C::groupChars - m_pending);
+            std::memcpy(m_group + m_pending, chunk.data(), n);
+            chunk.remove_prefix(n);
+
+            m_pending += n;
+            if (m_pending < C::groupChars)
+                return 0;
+
+            at += M_decode(std::string_view(m_group, C::groupChars), at);
+            m_pending = 0;
+        }
+
+        std::size_t whole = chunk.size() / C::groupChars * C::groupChars;
+        if (whole)
+            at += M_decode(chunk.substr(0, whole), at);
+
+        m_pending = chunk.size() - whole;
+        std::memcpy(m_group, chunk.data() + whole, m_pending);
+        return at - begin;
+    }
+
+    //! Tell if the text fed so far only contains valid characters.
+    bool valid() const
+    { return !m_bad; }
+
+    //! Tell if the text fed so far ends with a complete group.
+    bool complete() const
+    { return m_pending == 0; }
+
+private:
+    std::size_t M_decode(std::string_view text, uint8_t* out)
+    {
+        // Padding is only allowed at the end of the text
+        std::size_t size;
+        C::decodedSize(text, size);
+        m_bad |= m_padded || !C::decode(text, out);
+        m_padded = size < text.size() / C::groupChars * C::groupBytes;
+        return size;
+    }
+
+private:
+    char m_group[C::groupChars];
+    std::size_t m_pending;
+    bool m_bad;
+    bool m_padded;
+};
+
+// --------------------------------------------------------------------------------------
+// Writer
+// --------------------------------------------------------------------------------------
+
+#ifndef JSON_WRITER_BUFFER_SIZE
+# define JSON_WRITER_BUFFER_SIZE 65536
+#endif
+
+//! Buffered output sink, that documents are serialized to.
+//! Characters are accumulated and written to the output stream
+//!   by blocks of about JSON_WRITER_BUFFER_SIZE characters, or
+//!   kept in a growable buffer if there is no output stream.
+class Writer
+{
+public:
+    Writer() :
+        m_out(nullptr)
+    {}
+
+    Writer(std::ostream& out) :
+        m_out(&out)
+    { m_buffer.reserve(JSON_WRITER_BUFFER_SIZE); }
+
+    ~Writer()
+    { flush(); }
+
+    //! Write the buffered characters to the output stream (if any).
+    void flush()
+    {
+        if (!m_out)
+            return;
+
+        m_out->write(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+
+    //! Get the buffered characters (all of them if there
+    //!   is no output stream).
+    std::string const& str() const
+    { return m_buffer; }
+
+    void put(char ch)
+    {
+        m_buffer += ch;
+        M_check();
+    }
+
+    void write(std::string_view chars)
+    {
+        m_buffer.append(chars.data(), chars.size());
+        M_check();
+    }
+
+    //! Write the indentation for the given level.
+    void indent(int level)
+    {
+        static const char spaces[] = "                                ";
+        for (; level > 0; level -= sizeof(spaces) - 1)
+            m_buffer.append(spaces, std::min<std::size_t>(level, sizeof(spaces) - 1));
+        M_check();
+    }
+
+    //! Write a quoted string, escaping it as the Lexer expects.
+    void string(std::string_view value)
+    {
+        m_buffer += '"';
+        for (auto c : value)
+        {
+            if (c == '\n')
+                m_buffer += "\\n";
+            else if (c == '\t')
+                m_buffer += "\\t";
+            else if (c == '"')
+                m_buffer += "\\\"";
+            else if (c == '\\')
+                m_buffer += "\\\\";
+            else
+                m_buffer += c;
+        }
+        m_buffer += '"';
+        M_check();
+    }
+
+    //! Write an integral or real number, reals using their shortest
+    //!   round-trip representation.
+    template <typename T>
+    void number(T value)
+    {
+        static_assert(std::is_arithmetic<T>::value, "json::Writer::number: expecting an arithmetic type");
+
+        // JSON has no representation for infinities and NaNs
+        if constexpr (std::is_floating_point<T>::value)
+        {
+            if (!std::isfinite(value))
+            {
+                write("null");
+                return;
+            }
+        }
+
+        char buffer[32];
+        char* end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+        m_buffer.append(buffer, end);
+        M_check();
+    }
+
+    void boolean(bool value)
+    { write(value ? "true" : "false"); }
+
+    //! Write binary data as a quoted string, encoded with
+    //!   the given codec (see Hex and Base64).
+    template <typename C>
+    void binary(const void* data, std::size_t size)
+    {
+        m_buffer += '"';
+        M_encode<C>(data, size);
+        m_buffer += '"';
+        M_check();
+    }
+
+    //! Write binary data encoded with the given codec, without
+    //!   the quotes (so that it may be written by chunks of whole
+    //!   groups, see Blob).
+    template <typename C>
+    void encoded(const void* data, std::size_t size)
+    { M_encode<C>(data, size); }
+
+    //! Serialize a node tree (defined below).
+    void node(Node const* node, int level, bool indent);
+
+    //! Tell if a node is serialized on several lines (defined below).
+    static bool multiline(Node const* node);
+
+private:
+    void M_check()
+    {
+        if (m_out && m_buffer.size() >= JSON_WRITER_BUFFER_SIZE)
+            flush();
+    }
+
+    //! Encode binary data by slices of whole groups, so that the buffer
+    //!   may be flushed between them.
+    template <typename C>
+    void M_encode(const void* data, std::size_t size)
+    {
+        const std::size_t slice = std::max<std::size_t>(1, JSON_WRITER_BUFFER_SIZE / C::groupChars) * C::groupBytes;
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+        while (size > 0)
+        {
+            std::size_t n = std::min(size, slice);
+            std::size_t at = m_buffer.size();
+            m_buffer.resize(at + C::encodedSize(n));
+            C::encode(bytes, n, &m_buffer[at]);
+
+            bytes += n;
+            size -= n;
+            M_check();
+        }
+    }
+
+private:
+    std::ostream* m_out;
+    std::string m_buffer;
+};
+
+// --------------------------------------------------------------------------------------
+// Nodes
+// --------------------------------------------------------------------------------------
+
+#ifndef JSON_OBJECT_INDEX_THRESHOLD
+# define JSON_OBJECT_INDEX_THRESHOLD 16
+#endif
+
+#ifndef JSON_PACKED_ARRAY_THRESHOLD
+# define JSON_PACKED_ARRAY_THRESHOLD 16
+#endif
+
+class NumberNode;
+class BooleanNode;
+class StringNode;
+class ObjectNode;
+class ArrayNode;
+
+class Node
+{
+    //! Needed to access private members of *Node from
+    //!   M_serialize() and M_multiline().
+    friend class ObjectNode;
+    friend class ArrayNode;
+    friend class Writer;
+public:
+    enum Type
+    {
+        Number,
+        Boolean,
+        String,
+        Object,
+        Array,
+        Null
+    };
+    
+protected:
+    //! Only the location of the token is kept (see token()).
+    Node(Token const& token = Token()) : m_location(token.info()) {}
+    
+public:
+    virtual ~Node() {}
+    
+    //! Get the type of this node.
+    virtual Type type() const = 0;
+
+    //! Get the type string of this node.
+    static std::string typeName(Type type)
+    {
+        if (type == Number) return "Number";
+        else if (type == Boolean) return "Boolean";
+        else if (type == String) return "String";
+        else if (type == Object) return "Object";
+        else if (type == Array) return "Array";
+        else if (type == Null) return "Null";
+        
+        return "?";
+    }
+
+    //! Serialize the JSON tree whose root is this node to the
+    //!   given output stream.
+    //! If indent == false, no indentation is outputted
+    //!   (and you get a compact, single-line output).
+    void serialize(std::ostream& out, bool indent = true) const
+    {
+        Writer writer(out);
+        M_serialize(writer, 0, indent);
+    }
+
+    //! Same as above, to a writer.
+    void serialize(Writer& out, bool indent = true) const
+    { M_serialize(out, 0, indent); }
+    
+    template <typename T>
+    T* downcast()
+    { return M_downcast((T*) 0); }
+
+    template <typename T>
+    T const* downcast() const
+    { return const_cast<Node*>(this)->M_downcast((T*) 0); }
+
+    //! Get the token of this node, for error reports: only its type and
+    //!   its location are kept (its characters are in the node already).
+    Token token() const;
+
+    //! Deep copy the tree whose root is this node, allocating the
+    //!   copy in the given arena if any (or on the heap).
+    //! All the characters are copied, so that the copy doesn't refer
+    //!   to the resources of this tree.
+    Node* clone(Arena* arena = nullptr) const
+    { return M_clone(arena); }
+    
+protected:
+    virtual void M_serialize(Writer& out, int level, bool indent) const = 0;
+    virtual bool M_multiline() const = 0;
+    virtual Node* M_clone(Arena* arena) const = 0;
+
+    //! Create a new node, in the arena if any.
+    template <typename T, typename... Args>
+    static T* M_new(Arena* arena, Args&&... args)
+    {
+        T* node = arena ? arena->make<T>(std::forward<Args>(args)...) : new T(std::forward<Args>(args)...);
+        Stats::node(node);
+        return node;
+    }
+
+    static Text M_copy(Text const& text, Arena* arena)
+    {
+        if (arena)
+            return arena->intern(text.view());
+        return Text(std::string(text.view()));
+    }
+
+    template <typename T>
+    T* M_downcast(T*)
+    { return 0; }
+    
+    NumberNode* M_downcast(NumberNode*)
+    { return M_safeCast<Number, NumberNode>(); }
+    
+    BooleanNode* M_downcast(BooleanNode*)
+    { return M_safeCast<Boolean, BooleanNode>(); }
+    
+    StringNode* M_downcast(StringNode*)
+    { return M_safeCast<String, StringNode>(); }
+    
+    ObjectNode* M_downcast(ObjectNode*)
+    { return M_safeCast<Object, ObjectNode>(); }
+    
+    ArrayNode* M_downcast(ArrayNode*)
+    { return M_safeCast<Array, ArrayNode>(); }
+    
+    template <Type tp, typename T>
+    T* M_safeCast()
+    {
+        if (type() != tp) return 0;
+        return (T*) this;
+    }
+
+private:
+    //! Compact location of the token (whose line is 0 if there is none).
+    struct Location
+    {
+        Location(Token::Info const& info) :
+            offset(info.empty ? 0 : info.offset),
+            line(info.empty ? 0 : static_cast<uint32_t>(info.line)),
+            column(info.empty ? 0 : static_cast<uint32_t>(info.column))
+        {}
+
+        uint64_t offset;
+        uint32_t line;
+        uint32_t column;
+    };
+
+    Location m_location;
+};
+
+//! Numbers are stored exactly, either as signed or unsigned 64-bit
+//!   integers, or as double precision reals.
+class NumberNode : public Node
+{
+    //! Needed to pack numbers the same way (see ArrayNode).
+    friend class ArrayNode;
+public:
+    enum Kind
+    {
+        Integer,
+        Unsigned,
+        Real
+    };
+
+public:
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, int>::type = 0>
+    NumberNode(T value, Token const& token = Token()) : Node(token), m_kind(Integer)
+    { m_value.i = value; }
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, int>::type = 0>
+    NumberNode(T value, Token const& token = Token()) : Node(token), m_kind(Unsigned)
+    { m_value.u = value; }
+
+    NumberNode(double value, Token const& token = Token()) : Node(token), m_kind(Real)
+    { m_value.d = value; }
+
+    //! Convert a number token, choosing the kind from its shape: integral
+    //!   tokens are stored as integers (unless they are out of range).
+    explicit NumberNode(Token const& token) : Node(token)
+    { M_convert(token, m_kind, m_value); }
+
+    //! Single precision reals are stored as the double nearest to their
+    //!   shortest decimal representation (so 0.1f is stored as 0.1).
+    NumberNode(float value, Token const& token = Token()) : Node(token), m_kind(Real)
+    { m_value.d = M_widen(value); }
+    
+    Type type() const { return Number; }
+    Kind kind() const { return m_kind; }
+    double value() const { return as<double>(); }
+
+    //! Get the value converted to the given arithmetic type.
+    template <typename T>
+    T as() const
+    { return M_as<T>(m_kind, m_value); }
+
+    //! Convert a number token to the given arithmetic type
+    //!   (without creating a node).
+    template <typename T>
+    static T convert(Token const& token)
+    {
+        Kind kind;
+        Value value;
+        M_convert(token, kind, value);
+        return M_as<T>(kind, value);
+    }
+
+private:
+    union Value
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+    };
+
+    static double M_widen(float value)
+    {
+        char buffer[32];
+        char* end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+        double wide;
+        if (std::from_chars(buffer, end, wide).ec != std::errc())
+            wide = value;
+        return wide;
+    }
+
+    template <typename T>
+    static T M_as(Kind kind, Value const& value)
+    {
+        if (kind == Integer)
+            return static_cast<T>(value.i);
+        else if (kind == Unsigned)
+            return static_cast<T>(value.u);
+        return static_cast<T>(value.d);
+    }
+
+    static void M_convert(Token const& token, Kind& kind, Value& value)
+    {
+        std::string_view chars = token.value();
+        const char* first = chars.data();
+        const char* last = first + chars.size();
+
+        kind = Real;
+        if (token.flags() & Token::Integral)
+        {
+            // Prefer signed integers, that are less surprising to compute with
+            if (std::from_chars(first, last, value.i).ec == std::errc())
+            {
+                kind = Integer;
+                return;
+            }
+            else if (!(token.flags() & Token::Negative) && std::from_chars(first, last, value.u).ec == std::errc())
+            {
+                kind = Unsigned;
+                return;
+            }
+        }
+
+        // Out of range reals saturate (or underflow), like std::strtod does
+        if (std::from_chars(first, last, value.d).ec != std::errc())
+            value.d = std::strtod(std::string(chars).c_str(), nullptr);
+    }
+
+    void M_serialize(Writer& out, int level, bool indent) const
+    {
+        if (indent) out.indent(level);
+
+        if (m_kind == Integer)
+            out.number(m_value.i);
+        else if (m_kind == Unsigned)
+            out.number(m_value.u);
+        else
+            out.number(m_value.d);
+    }
+
+    bool M_multiline() const { return false; }
+
+    Node* M_clone(Arena* arena) const
+    { return M_new<NumberNode>(arena, *this); }
+    
+private:
+    Kind m_kind;
+    Value m_value;
+};
+
+class BooleanNode : public Node
+{
+public:
+    BooleanNode(bool value, Token const& token = Token()) : Node(token), m_value(value) {}
+    
+    Type type() const { return Boolean; }
+    bool value() const { return m_value; }
+    
+private:
+    void M_serialize(Writer& out, int level, bool indent) const
+    {
+        if (indent) out.indent(level);
+        out.boolean(m_value);
+    }
+
+    bool M_multiline() const { return false; }
+
+    Node* M_clone(Arena* arena) const
+    { return M_new<BooleanNode>(arena, m_value, token()); }
+    
+private:
+    bool m_value;
+};
+
+class StringNode : public Node
+{
+public:
+    StringNode(Text value, Token const& token = Token()) : Node(token), m_value(std::move(value)) {}
+    
+    Type type() const { return String; }
+    std::string_view value() const { return m_value.view(); }
+    Text const& text() const { return m_value; }
+
+    std::string escapedValue() const
+    { return escape(m_value.view()); }
+
+    //! Escape a string as the Lexer expects.
+    static std::string escape(std::string_view value)
+    {
+        std::string escaped;
+
+        for (auto c : value)
+        {
+            if (c == '\n')
+                escaped += "\\n";
+            else if (c == '\t')
+                escaped += "\\t";
+            else if (c == '"')
+                escaped += "\\\"";
+            else if (c == '\\')
+                escaped += "\\\\";
+            else
+                escaped += c;
+        }
+
+        return escaped;
+    }
+    
+private:
+    void M_serialize(Writer& out, int level, bool indent) const
+    {
+        if (indent) out.indent(level);
+        out.string(m_value.view());
+    }
+
+    bool M_multiline() const { return false; }
+
+    Node* M_clone(Arena* arena) const
+    { return M_new<StringNode>(arena, M_copy(m_value, arena), token()); }
+    
+private:
+    Text m_value;
+};
+
+//! Objects store their entries contiguously, in insertion order.
+//! Lookups are linear scans for small objects, and go through a small
+//!   open-addressing hash index once the object has more than
+//!   JSON_OBJECT_INDEX_THRESHOLD entries.
+class ObjectNode : public Node
+{
+public:
+    typedef std::pair<Text, Node*> Entry;
+
+public:
+    //! Own memory for the object entries is obtained from the given
+    //!   resource (typically the one of an Arena).
+    ObjectNode(Token const& token = Token(),
+               std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        Node(token),
+        m_impl(resource),
+        m_index(resource)
+    {}
+
+    ~ObjectNode()
+    {
+        for (auto it = m_impl.begin(); it != m_impl.end(); ++it)
+             delete it->second;
+    }
+    
+    Type type() const { return Object; }
+    std::size_t size() const { return m_impl.size(); }
+    bool exists(std::string_view key) const { return M_find(key, hash(key)) >= 0; }
+
+    //! Get the value of an entry (or nullptr if there is none).
+    Node* find(std::string_view key)
+    { return find(key, hash(key)); }
+
+    Node const* find(std::string_view key) const
+    { return find(key, hash(key)); }
+
+    //! Same as above, given the precomputed hash(key).
+    Node* find(std::string_view key, uint32_t h)
+    {
+        long i = M_find(key, h);
+        return i < 0 ? nullptr : m_impl[i].second;
+    }
+
+    Node const* find(std::string_view key, uint32_t h) const
+    { return const_cast<ObjectNode*>(this)->find(key, h); }
+
+    //! Get a reference to the value of an entry, creating it if needed.
+    //! The reference is invalidated when other entries are inserted.
+    Node*& get(std::string_view key)
+    {
+        uint32_t h = hash(key);
+        long i = M_find(key, h);
+        if (i < 0)
+            i = M_insert(Text(std::string(key)), nullptr, h);
+        return m_impl[i].second;
+    }
+
+    //! Get the value of an entry, without ever creating it (lookups of
+    //!   const objects are safe to run concurrently).
+    Node const* get(std::string_view key) const
+    {
+        long i = M_find(key, hash(key));
+        if (i < 0) throw std::out_of_range("json::ObjectNode::get: no such key");
+        return m_impl[i].second;
+    }
+
+    //! Insert a new entry, returns false (leaving the object unchanged)
+    //!   if the key already exists.
+    bool insert(Text key, Node* value)
+    {
+        uint32_t h = hash(key.view());
+        if (M_find(key.view(), h) >= 0)
+            return false;
+
+        M_insert(std::move(key), value, h);
+        return true;
+    }
+
+    //! Remove an entry, returning its value (that the caller then owns,
+    //!   unless it lives in an arena), or nullptr if there is none.
+    //! The following entries keep their order (and the index is rebuilt).
+    Node* erase(std::string_view key)
+    {
+        long i = M_find(key, hash(key));
+        if (i < 0)
+            return nullptr;
+
+        Node* value = m_impl[i].second;
+        m_impl.erase(m_impl.begin() + i);
+        if (!m_index.empty())
+            M_reindex();
+        return value;
+    }
+
+    //! Get a reference to the value of the i-th entry (in insertion order).
+    Node*& value(std::size_t i)
+    {
+        if (i >= m_impl.size()) throw std::domain_error("json::ObjectNode::value: index out of bounds");
+        return m_impl[i].second;
+    }
+
+    //! Get the entries, in insertion order.
+    //! Entries must only be added through get() and insert(), removed
+    //!   through erase(), and their values changed through value().
+    std::pmr::vector<Entry> const& impl() const { return m_impl; }
+
+    //! The hash of object keys (FNV-1a), also computed at compile time
+    //!   for the fields of reflected types.
+    static constexpr uint32_t hash(std::string_view key)
+    {
+        uint32_t h = 2166136261u;
+        for (char c : key)
+            h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+        return h;
+    }
+    
+private:
+    long M_find(std::string_view key, uint32_t h) const
+    {
+        if (m_index.empty())
+        {
+            for (std::size_t i = 0; i < m_impl.size(); ++i)
+                if (m_impl[i].first.view() == key)
+                    return static_cast<long>(i);
+            return -1;
+        }
+
+        std::size_t mask = m_index.size() - 1;
+        for (std::size_t slot = h & mask; m_index[slot]; slot = (slot + 1) & mask)
+        {
+            std::size_t i = m_index[slot] - 1;
+            if (m_impl[i].first.view() == key)
+                return static_cast<long>(i);
+        }
+
+        return -1;
+    }
+
+    long M_insert(Text key, Node* value, uint32_t h)
+    {
+        m_impl.emplace_back(std::move(key), value);
+
+        if (m_impl.size() > JSON_OBJECT_INDEX_THRESHOLD)
+        {
+            // Keep the index at most half full
+            if (2 * m_impl.size() > m_index.size())
+                M_reindex();
+            else
+                M_indexLast(h);
+        }
+
+        return static_cast<long>(m_impl.size() - 1);
+    }
+
+    void M_reindex()
+    {
+        std::size_t capacity = 64;
+        while (capacity < 4 * m_impl.size())
+            capacity *= 2;
+
+        m_index.assign(capacity, 0);
+        for (std::size_t i = 0; i < m_impl.size(); ++i)
+            M_index(i, hash(m_impl[i].first.view()));
+    }
+
+    void M_indexLast(uint32_t h)
+    { M_index(m_impl.size() - 1, h); }
+
+    void M_index(std::size_t i, uint32_t h)
+    {
+        std::size_t mask = m_index.size() - 1;
+        std::size_t slot = h & mask;
+        while (m_index[slot])
+            slot = (slot + 1) & mask;
+        m_index[slot] = static_cast<uint32_t>(i + 1);
+    }
+
+    void M_serialize(Writer& out, int level, bool indent) const
+    {
+        if (indent) out.indent(level);
+        out.put('{');
+        if (indent) out.put('\n');
+        
+        for (std::size_t i = 0; i < m_impl.size(); ++i)
+        {
+            Entry const& entry = m_impl[i];
+
+            if (indent) out.indent(level + 4);
+            out.string(entry.first.view());
+            out.write(": ");
+            
+            if (indent && entry.second->M_multiline())
+            {
+                out.put('\n');
+                entry.second->M_serialize(out, level + 4, indent);
+            }
+            else
+            {
+                entry.second->M_serialize(out, 0, false);
+            }
+            
+            if (i != m_impl.size()-1)
+                out.write(", ");
+            if (indent) out.put('\n');
+        }
+        
+        if (indent) out.indent(level);
+        out.put('}');
+    }
+
+    bool M_multiline() const { return true; }
+
+    Node* M_clone(Arena* arena) const
+    {
+        ObjectNode* node = M_new<ObjectNode>(arena, token(),
+                                             arena ? arena->resource() : std::pmr::get_default_resource());
+        std::unique_ptr<ObjectNode> release(arena ? nullptr : node);
+
+        for (Entry const& entry : m_impl)
+            node->M_insert(M_copy(entry.first, arena), entry.second->M_clone(arena), hash(entry.first.view()));
+
+        release.release();
+        return node;
+    }
+    
+private:
+    std::pmr::vector<Entry> m_impl;
+    //! Slots hold entry indices + 1 (0 is an empty slot)
+    std::pmr::vector<uint32_t> m_index;
+};
+
+//! Arrays of at least JSON_PACKED_ARRAY_THRESHOLD numbers are packed by
+//!   the parsers: their numbers are stored contiguously, either as 64-bit
+//!   integers, or as reals (remembering those that were integers), rather
+//!   than by a node each.
+//! Their nodes are only created when they are accessed (through at() or
+//!   impl()), which vectors of numbers and serialization don't need.
+//! Creating the nodes from a const array is thread safe, while accessing
+//!   a non-const one returns it for good to its unpacked representation.
+class ArrayNode : public Node
+{
+    //! Needed to pack the arrays they build, or to access packed numbers.
+    friend class Parser;
+    friend class PushParser;
+    friend struct Binary;
+    template <typename T> friend class Vector;
+    template <typename T, typename E> friend struct Codec;
+public:
+    //! Own memory for the array elements is obtained from the given
+    //!   resource (typically the one of an Arena).
+    ArrayNode(Token const& token = Token(),
+              std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        Node(token),
+        m_impl(resource),
+        m_packed(nullptr)
+    {}
+
+    ~ArrayNode()
+    {
+        for (unsigned int i = 0; i < m_impl.size(); ++i)
+            delete m_impl[i];
+        if (m_packed)
+            M_stopPacking();
+    }
+    
+    Type type() const { return Array; }
+    size_t size() const { return m_packed ? m_packed->size() : m_impl.size(); }
+    Node*& at(size_t i)
+    {
+        M_release();
+        if (i >= m_impl.size()) throw std::domain_error("json::ArrayNode::at: index out of bounds");
+        return m_impl[i];
+    }
+
+    Node const* at(size_t i) const
+    {
+        M_unpack();
+        if (i >= m_impl.size()) throw std::domain_error("json::ArrayNode::at: index out of bounds");
+        return m_impl[i];
+    }
+
+    std::pmr::vector<Node*>& impl() { M_release(); return m_impl; }
+    std::pmr::vector<Node*> const& impl() const { M_unpack(); return m_impl; }
+
+    //! Tell if the numbers of the array are packed.
+    bool packed() const
+    { return m_packed; }
+
+    //! Convert the numbers of a packed array to the given arithmetic
+    //!   type (as NumberNode::as() does), in a single loop.
+    template <typename T>
+    void numbers(T* out) const
+    {
+        static_assert(std::is_arithmetic<T>::value, "json::ArrayNode::numbers: expecting an arithmetic type");
+
+        if (!m_packed)
+            throw std::logic_error("json::ArrayNode::numbers: not a packed array");
+
+        // Plain loops, left to the compiler to vectorize
+        std::size_t count = m_packed->size();
+        if (m_packed->kind == NumberNode::Integer)
+        {
+            int64_t const* integers = m_packed->integers.data();
+            for (std::size_t i = 0; i < count; ++i)
+                out[i] = static_cast<T>(integers[i]);
+        }
+        else
+        {
+            double const* reals = m_packed->reals.data();
+            for (std::size_t i = 0; i < count; ++i)
+                out[i] = static_cast<T>(reals[i]);
+        }
+    }
+    
+private:
+    //! Packed numbers, either all integers or all reals.
+    //! Reals also hold integers that they can represent exactly, these
+    //!   being flagged as integral (if there are some).
+    struct Packed
+    {
+        Packed(Arena* arena) :
+            kind(NumberNode::Integer),
+            arena(arena),
+            integers(M_resource(arena)),
+            reals(M_resource(arena)),
+            integral(M_resource(arena))
+        {}
+
+        std::size_t size() const
+        { return kind == NumberNode::Integer ? integers.size() : reals.size(); }
+
+        bool isIntegral(std::size_t i) const
+        { return kind == NumberNode::Integer || (!integral.empty() && integral[i]); }
+
+        NumberNode::Kind kind;
+        //! Where the nodes are created (on the heap if none)
+        Arena* arena;
+        std::pmr::vector<int64_t> integers;
+        std::pmr::vector<double> reals;
+        std::pmr::vector<bool> integral;
+        std::once_flag unpacked;
+    };
+
+    static std::pmr::memory_resource* M_resource(Arena* arena)
+    { return arena ? arena->resource() : std::pmr::get_default_resource(); }
+
+    //! Integers that reals represent exactly.
+    static bool M_exact(int64_t value)
+    { return value >= -(int64_t(1) << 53) && value <= (int64_t(1) << 53); }
+
+    //! Get the packed number at i, as a node.
+    Node* M_node(std::size_t i, Arena* arena) const
+    {
+        if (m_packed->kind == NumberNode::Integer)
+            return M_new<NumberNode>(arena, m_packed->integers[i]);
+        else if (m_packed->isIntegral(i))
+            return M_new<NumberNode>(arena, static_cast<int64_t>(m_packed->reals[i]));
+        return M_new<NumberNode>(arena, m_packed->reals[i]);
+    }
+
+    //! Start packing an empty array (its nodes created in the arena if any).
+    void M_startPacking(Arena* arena)
+    { m_packed = arena ? arena->make<Packed>(arena) : new Packed(nullptr); }
+
+    //! Stop packing, without creating the nodes.
+    void M_stopPacking()
+    {
+        if (!m_packed->arena)
+            delete m_packed;
+        m_packed = nullptr;
+    }
+
+    //! Pack the items of the array, if they all are numbers that can be.
+    bool M_pack(Arena* arena)
+    {
+        if (m_packed)
+            return true;
+
+        M_startPacking(arena);
+        for (Node* item : m_impl)
+        {
+            NumberNode* number = item->downcast<NumberNode>();
+            if (!number || !M_push(number->m_kind, number->m_value))
+            {
+                M_stopPacking();
+                return false;
+            }
+        }
+
+        if (!arena)
+        {
+            for (Node* item : m_impl)
+                delete item;
+        }
+        m_impl.clear();
+        m_impl.shrink_to_fit();
+        return true;
+    }
+
+    //! Pack arithmetic values to an empty array, if they all can be.
+    template <typename T>
+    bool M_pack(T const* values, std::size_t count)
+    {
+        M_startPacking(nullptr);
+        if constexpr (std::is_integral<T>::value)
+        {
+            m_packed->integers.reserve(count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if constexpr (std::is_unsigned<T>::value && sizeof(T) >= sizeof(int64_t))
+                {
+                    if (values[i] > static_cast<uint64_t>(INT64_MAX))
+                    {
+                        M_stopPacking();
+                        return false;
+                    }
+                }
+                m_packed->integers.push_back(static_cast<int64_t>(values[i]));
+            }
+        }
+        else
+        {
+            m_packed->kind = NumberNode::Real;
+            m_packed->reals.resize(count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if constexpr (std::is_same<T, float>::value)
+                    m_packed->reals[i] = NumberNode::M_widen(values[i]);
+                else
+                    m_packed->reals[i] = static_cast<double>(values[i]);
+            }
+        }
+        return true;
+    }
+
+    //! Append a number to a packed array, if it can be.
+    bool M_push(NumberNode::Kind kind, NumberNode::Value const& value)
+    {
+        if (kind == NumberNode::Integer)
+            return M_push(value.i);
+        else if (kind == NumberNode::Real)
+            return M_push(value.d);
+        return false;
+    }
+
+    bool M_push(Token const& token)
+    {
+        NumberNode::Kind kind;
+        NumberNode::Value value;
+        NumberNode::M_convert(token, kind, value);
+        return M_push(kind, value);
+    }
+
+    bool M_push(int64_t value)
+    {
+        Packed& packed = *m_packed;
+        if (packed.kind == NumberNode::Integer)
+        {
+            packed.integers.push_back(value);
+            return true;
+        }
+
+        if (!M_exact(value))
+            return false;
+        if (packed.integral.empty())
+            packed.integral.resize(packed.reals.size(), false);
+        packed.reals.push_back(static_cast<double>(value));
+        packed.integral.push_back(true);
+        return true;
+    }
+
+    bool M_push(double value)
+    {
+        Packed& packed = *m_packed;
+        if (packed.kind == NumberNode::Integer)
+        {
+            // Switch to reals, if they can represent the integers so far
+            for (int64_t integer : packed.integers)
+            {
+                if (!M_exact(integer))
+                    return false;
+            }
+
+            packed.kind = NumberNode::Real;
+            packed.reals.assign(packed.integers.begin(), packed.integers.end());
+            packed.integral.assign(packed.integers.size(), true);
+            packed.integers.clear();
+            packed.integers.shrink_to_fit();
+        }
+
+        packed.reals.push_back(value);
+        if (!packed.integral.empty())
+            packed.integral.push_back(false);
+        return true;
+    }
+
+    //! Create the nodes of a packed array (once), keeping its numbers.
+    void M_unpack() const
+    {
+        if (!m_packed)
+            return;
+
+        std::call_once(m_packed->unpacked, [this]()
+        {
+            std::size_t count = m_packed->size();
+            m_impl.reserve(count);
+            for (std::size_t i = 0; i < count; ++i)
+                m_impl.push_back(M_node(i, m_packed->arena));
+        });
+    }
+
+    //! Unpack the array for good, before it is accessed for writing.
+    void M_release()
+    {
+        if (!m_packed)
+            return;
+
+        M_unpack();
+        M_stopPacking();
+    }
+
+    void M_serialize(Writer& out, int level, bool indent) const
+    {
+        if (m_packed)
+        {
+            if (indent) out.indent(level);
+            out.put('[');
+            std::size_t count = m_packed->size();
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (i) out.write(", ");
+                if (m_packed->kind == NumberNode::Integer)
+                    out.number(m_packed->integers[i]);
+                else if (m_packed->isIntegral(i))
+                    out.number(static_cast<int64_t>(m_packed->reals[i]));
+                else
+                    out.number(m_packed->reals[i]);
+            }
+            out.put(']');
+            return;
+        }
+
+        if (indent) out.indent(level);
+        out.put('[');
+        bool multi = indent && M_multiline();
+        if (multi) out.put('\n');
+        
+        for (unsigned int i = 0; i < m_impl.size(); ++i)
+        {
+            if (multi)
+            {
+                m_impl[i]->M_serialize(out, level + 4, indent);
+            }
+            else
+            {
+                m_impl[i]->M_serialize(out, 0, false);
+            }
+            
+            if (i != m_impl.size()-1)
+                out.write(", ");
+            if (multi) out.put('\n');
+        }
+        
+        if (multi) out.indent(level);
+        out.put(']');
+    }
+
+    bool M_multiline() const
+    {
+        // Numbers are never written on several lines
+        if (m_packed)
+            return false;
+
+        for (unsigned int i = 0; i < m_impl.size(); ++i)
+            if (m_impl[i]->M_multiline())
+                return true;
+        return false;
+    }
+
+    Node* M_clone(Arena* arena) const
+    {
+        ArrayNode* node = M_new<ArrayNode>(arena, token(),
+                                           arena ? arena->resource() : std::pmr::get_default_resource());
+        std::unique_ptr<ArrayNode> release(arena ? nullptr : node);
+
+        if (m_packed)
+        {
+            node->M_startPacking(arena);
+            node->m_packed->kind = m_packed->kind;
+            node->m_packed->integers.assign(m_packed->integers.begin(), m_packed->integers.end());
+            node->m_packed->reals.assign(m_packed->reals.begin(), m_packed->reals.end());
+            node->m_packed->integral.assign(m_packed->integral.begin(), m_packed->integral.end());
+        }
+        else
+        {
+            node->m_impl.reserve(m_impl.size());
+            for (Node* item : m_impl)
+                node->m_impl.push_back(item->M_clone(arena));
+        }
+
+        release.release();
+        return node;
+    }
+    
+private:
+    mutable std::pmr::vector<Node*> m_impl;
+    Packed* m_packed;
+};
+
+class NullNode : public Node
+{
+public:
+    NullNode(Token const& token = Token()) : Node(token) {}
+    
+    Type type() const { return Null; }
+    
+private:
+    void M_serialize(Writer& out, int level, bool indent) const
+    {
+        if (indent) out.indent(level);
+        out.write("null");
+    }
+
+    bool M_multiline() const { return false; }
+
+    Node* M_clone(Arena* arena) const
+    { return M_new<NullNode>(arena, token()); }
+    
+private:
+};
+
+inline void Writer::node(Node const* node, int level, bool indent)
+{
+    if (node)
+        node->M_serialize(*this, level, indent);
+}
+
+inline bool Writer::multiline(Node const* node)
+{ return node && node->M_multiline(); }
+
+inline Token Node::token() const
+{
+    Token::Type tt = Token::Null;
+    Type tp = type();
+    if (tp == Number)
+        tt = Token::Number;
+    else if (tp == Boolean)
+        tt = static_cast<BooleanNode const*>(this)->value() ? Token::True : Token::False;
+    else if (tp == String)
+        tt = Token::String;
+    else if (tp == Object)
+        tt = Token::LeftBrace;
+    else if (tp == Array)
+        tt = Token::LeftBracket;
+
+    Token token(tt);
+    if (m_location.line)
+    {
+        Token::Info info;
+        info.line = static_cast<int>(m_location.line);
+        info.column = static_cast<int>(m_location.column);
+        info.offset = static_cast<std::size_t>(m_location.offset);
+        token.setInfo(info);
+    }
+    return token;
+}
+
+inline Token NodeError::token() const
+{ return m_node ? m_node->token() : m_token; }
+
+//! The outcome of a non-throwing parse or extraction: a code, and the
+//!   location of the offending token (or node) for failures.
+//! Messages are the ones of the exceptions that would be thrown, but
+//!   they are only built when asked for.
+//! A status owns what it reports, so that it remains valid once the
+//!   input, its tree or the template are gone.
+class Status
+{
+public:
+    enum Code
+    {
+        Ok,
+        //! Syntax errors (as a TokenError)
+        Syntax,
+        //! Values of unexpected types
+        Mismatch,
+        //! Missing object entries
+        Missing,
+        //! Arrays with too few elements
+        Size,
+        //! Other errors, reported by exceptions
+        Other
+    };
+
+public:
+    Status() :
+        m_code(Ok),
+        m_what(""),
+        m_detail(None),
+        m_type(Node::Null)
+    {}
+
+    //! A failure, whose message is what (which must be a literal,
+    //!   and which may be followed by a detail).
+    Status(Code code, const char* what, Token const& token) :
+        m_code(code),
+        m_what(what),
+        m_token(M_own(token)),
+        m_detail(None),
+        m_type(Node::Null)
+    {}
+
+    //! Same as above, located at a node (whose location is copied).
+    Status(Code code, const char* what, Node const* node) :
+        m_code(code),
+        m_what(what),
+        m_token(M_own(node->token())),
+        m_detail(None),
+        m_type(Node::Null)
+    {}
+
+    //! Follow the message with a key (which is copied) and a closing
+    //!   quote (by default, the text of the offending token).
+    Status& key(std::string_view key = std::string_view())
+    {
+        m_detail = key.data() ? Key : TokenText;
+        m_key = key.data() ? Text(key) : Text();
+        return *this;
+    }
+
+    //! Follow the message with the name of the expected type.
+    Status& expected(Node::Type type)
+    {
+        m_detail = Expected;
+        m_type = type;
+        return *this;
+    }
+
+    //! A failure reported by an exception (whose message is copied).
+    static Status from(std::exception const& e)
+    {
+        Status status(Other, "", Token());
+        if (auto error = dynamic_cast<TokenError const*>(&e))
+        {
+            status.m_code = Syntax;
+            status.m_token = M_own(error->token());
+        }
+        else if (auto error = dynamic_cast<NodeError const*>(&e))
+        {
+            status.m_code = Mismatch;
+            status.m_token = M_own(error->token());
+        }
+
+        status.m_message = e.what();
+        return status;
+    }
+
+    bool ok() const { return m_code == Ok; }
+    explicit operator bool() const { return ok(); }
+
+    Code code() const { return m_code; }
+
+    //! Get the offending token.
+    Token const& token() const
+    { return m_token; }
+
+    std::string what() const
+    {
+        if (!m_message.empty())
+            return m_message;
+
+        std::string what = m_what;
+        if (m_detail == Key)
+            what.append(m_key.view()).append("'");
+        else if (m_detail == TokenText)
+            what.append(m_token.text().view()).append("'");
+        else if (m_detail == Expected)
+            what += Node::typeName(m_type);
+        return what;
+    }
+
+    //! Get the message, as TokenError::message() or NodeError::message().
+    std::string message() const
+    {
+        std::ostringstream ss;
+        ss << (m_code == Syntax ? "Token error [" : "Node error [")
+           << token().info().line << ":" << token().info().column << "]"
+           << ": " << what();
+        return ss.str();
+    }
+
+    //! Throw the exception that reports this failure.
+    [[noreturn]] void raise() const
+    {
+        if (m_code == Syntax)
+            throw TokenError(m_token, what());
+        else if (m_code == Other && !*m_what)
+            throw std::runtime_error(what());
+        throw NodeError(m_token, what());
+    }
+
+private:
+    enum Detail
+    {
+        None,
+        Key,
+        TokenText,
+        Expected
+    };
+
+    //! Copy a token whose text refers to the input.
+    static Token M_own(Token const& token)
+    {
+        if (token.text().owned())
+            return token;
+
+        Token owned(token.type(), Text(token.text().view()), token.flags());
+        owned.setInfo(token.info());
+        return owned;
+    }
+
+private:
+    Code m_code;
+    const char* m_what;
+    Token m_token;
+
+    Detail m_detail;
+    Text m_key;
+    Node::Type m_type;
+
+    //! Message of an exception
+    std::string m_message;
+};
+
+// --------------------------------------------------------------------------------------
+// Parser
+// --------------------------------------------------------------------------------------
+
+//! The parser builds trees of heap-allocated nodes (to be released
+//!   with delete), or of nodes allocated in an Arena if one is given
+//!   (that must then never be deleted, the arena owning them).
+//! Included files are resolved by the given resolver, so that they can
+//!   be cached across parses (or by the parser's own one otherwise).
+class Parser
+{
+public:
+    Parser(Lexer& lex, Arena* arena = nullptr, IncludeResolver* includes = nullptr) :
+        m_lex(lex),
+        m_arena(arena),
+        m_includes(includes)
+    {}
+
+    ~Parser();
+    
+    Node* parse()
+    {
+        Stats::Scope scope(Stats::Parsing);
+        if (m_lex.seek().type() == Token::LeftBrace)
+            return M_object();
+
+        return M_array();
+    }
+
+    //! Parse a single value, of any type.
+    Node* value()
+    {
+        Stats::Scope scope(Stats::Parsing);
+        return M_atom();
+    }
+
+    //! Same as parse(), reporting errors through the status instead
+    //!   of throwing (returns nullptr on errors).
+    Node* parse(Status& status)
+    { return M_try(status, &Parser::parse); }
+
+    //! Same as value(), reporting errors through the status.
+    Node* value(Status& status)
+    { return M_try(status, &Parser::value); }
+
+    //! Skip a single value, only checking its syntax (without building
+    //!   any node, nor opening included files).
+    void skip()
+    { M_skip(); }
+
+    //! Same as above, reporting errors through the status (returns
+    //!   false on errors).
+    bool skip(Status& status)
+    {
+        status = Status();
+        m_status = &status;
+        bool ok = M_skip();
+        m_status = nullptr;
+        return ok;
+    }
+    
+private:
+    //! Releases nodes on errors, unless they belong to the arena.
+    struct Release
+    {
+        bool heap;
+        void operator()(Node* node) const { if (heap) delete node; }
+    };
+
+    //! Create a new node (in the arena if any).
+    template <typename T, typename... Args>
+    T* M_make(Args&&... args)
+    {
+        T* node = m_arena ? m_arena->make<T>(std::forward<Args>(args)...) : new T(std::forward<Args>(args)...);
+        Stats::node(node);
+        return node;
+    }
+
+    //! Get the memory resource for node containers.
+    std::pmr::memory_resource* M_resource() const
+    { return m_arena ? m_arena->resource() : std::pmr::get_default_resource(); }
+
+    //! Characters owned by arena nodes must also live in the arena,
+    //!   as their destructors are never run.
+    Text M_text(Text const& text)
+    {
+        if (m_arena && text.owned())
+            return m_arena->intern(text.view());
+        return text;
+    }
+
+    Token M_token(Token const& token)
+    {
+        if (!m_arena || !token.text().owned())
+            return token;
+
+        Token interned(token.type(), M_text(token.text()), token.flags());
+        interned.setInfo(token.info());
+        return interned;
+    }
+
+    Node* M_atom()
+    {
+        Token::Type type = m_lex.seek().type();
+        if (type == Token::Bad)
+        {
+            return M_fail(Status(Status::Syntax, "bad token", m_lex.seek()));
+        }
+        else if (type == Token::True ||
+                 type == Token::False)
+        {
+            Token next = m_lex.get();
+            return M_make<BooleanNode>(type == Token::True, next);
+        }
+        else if (type == Token::Null)
+        {
+            return M_make<NullNode>(m_lex.get());
+        }
+        else if (type == Token::Number)
+        {
+            return M_make<NumberNode>(m_lex.get());
+        }
+        else if (type == Token::String)
+        {
+            Token next = M_token(m_lex.get());
+            return M_make<StringNode>(next.text(), next);
+        }
+        else if (type == Token::LeftBrace)
+            return M_object();
+        else if (type == Token::LeftBracket)
+            return M_array();
+        else if (type == Token::Include)
+        {
+            Node* tree = M_include(m_lex.seek().text().str());
+            m_lex.get();
+            return tree;
+        }
+
+        return M_fail(Status(Status::Syntax, "unexpected token", m_lex.seek()));
+    }
+
+    //! Parse with the given function, reporting errors through the status.
+    Node* M_try(Status& status, Node* (Parser::*parse)())
+    {
+        status = Status();
+        m_status = &status;
+
+        Node* node = nullptr;
+        try
+        {
+            node = (this->*parse)();
+        }
+        catch (std::exception const& e)
+        {
+            // Errors of included files, or of memory allocations
+            status = Status::from(e);
+        }
+
+        m_status = nullptr;
+        return node;
+    }
+
+    //! Report an error, either by throwing or through the status
+    //!   (returns nullptr then).
+    Node* M_fail(Status const& failure)
+    {
+        if (!m_status)
+            failure.raise();
+
+        *m_status = failure;
+        return nullptr;
+    }
+
+    //! Copy the tree of an included file (defined below).
+    Node* M_include(std::string const& file);
+
+    bool M_skip()
+    {
+        Token::Type type = m_lex.seek().type();
+        if (type == Token::Bad)
+            return M_fail(Status(Status::Syntax, "bad token", m_lex.seek()));
+
+        if (type == Token::LeftBrace)
+        {
+            m_lex.get();
+            while (m_lex.seek().type() != Token::RightBrace)
+            {
+                if (m_lex.seek().type() != Token::String)
+                    return M_fail(Status(Status::Syntax, "expected a identifier key", m_lex.seek()));
+                m_lex.get();
+
+                if (m_lex.seek().type() != Token::Colon)
+                    return M_fail(Status(Status::Syntax, "expected `:' after identifier", m_lex.seek()));
+                m_lex.get();
+
+                if (!M_skip())
+                    return false;
+
+                if (m_lex.seek().type() != Token::Comma)
+                    break;
+                m_lex.get();
+            }
+
+            if (m_lex.seek().type() != Token::RightBrace)
+                return M_fail(Status(Status::Syntax, "expected `}' at end of object declaration", m_lex.seek()));
+            m_lex.get();
+        }
+        else if (type == Token::LeftBracket)
+        {
+            m_lex.get();
+            while (m_lex.seek().type() != Token::RightBracket)
+            {
+                if (!M_skip())
+                    return false;
+
+                if (m_lex.seek().type() != Token::Comma)
+                    break;
+                m_lex.get();
+            }
+
+            if (m_lex.seek().type() != Token::RightBracket)
+                return M_fail(Status(Status::Syntax, "expected `]' at end of array declaration", m_lex.seek()));
+            m_lex.get();
+        }
+        else if (type == Token::True || type == Token::False || type == Token::Null ||
+                 type == Token::Number || type == Token::String || type == Token::Include)
+            m_lex.get();
+        else
+            return M_fail(Status(Status::Syntax, "unexpected token", m_lex.seek()));
+
+        return true;
+    }
+
+    Node* M_object()
+    {
+        Stats::Nesting nesting;
+
+        // Eat the opening {
+        if (m_lex.seek().type() != Token::LeftBrace)
+            return M_fail(Status(Status::Syntax, "expected `{' at beginning of object declaration", m_lex.seek()));
+        
+        // Create appropriate node (released on errors)
+        std::unique_ptr<ObjectNode, Release> node(M_make<ObjectNode>(m_lex.get(), M_resource()), Release{!m_arena});
+
+        // Parse object entries
+        for (;;)
+        {
+            // Allow empty objects
+            if (m_lex.seek().type() == Token::RightBrace)
+                break;
+
+            // Get key identifier
+            if (m_lex.seek().type() != Token::String)
+                return M_fail(Status(Status::Syntax, "expected a identifier key", m_lex.seek()));
+            Token token = m_lex.get();
+
+            // Get the separator
+            if (m_lex.seek().type() != Token::Colon)
+                return M_fail(Status(Status::Syntax, "expected `:' after identifier", m_lex.seek()));
             m_lex.get();
-            return new StringNode(next.value(), next);
+
+            // Parse the object element value
+            std::unique_ptr<Node, Release> value(M_atom(), Release{!m_arena});
+            if (!value)
+                return nullptr;
+            if (!node->insert(M_text(token.text()), value.get()))
+                return M_fail(Status(Status::Syntax, "redifinition of object entry `", token).key());
+            value.release();
+
+            // Eat comma, if needed
+            if (m_lex.seek().type() == Token::Comma)
+                m_lex.get();
+            else
+                break;
+        }
+
+        // Eat the closing }
+        if (m_lex.seek().type() != Token::RightBrace)
+            return M_fail(Status(Status::Syntax, "expected `}' at end of object declaration", m_lex.seek()));
+        m_lex.get();
+
+        return node.release();
+    }
+
+    Node* M_array()
+    {
+        Stats::Nesting nesting;
+
+        // Eat the opening [
+        if (m_lex.seek().type() != Token::LeftBracket)
+            return M_fail(Status(Status::Syntax, "expected `[' at beginning of array definition", m_lex.seek()));
+
+        // Create appropriate node (released on errors)
+        std::unique_ptr<ArrayNode, Release> node(M_make<ArrayNode>(m_lex.get(), M_resource()), Release{!m_arena});
+
+        // Parse array entries
+        for (;;)
+        {
+            // Allow empty arrays
+            if (m_lex.seek().type() == Token::RightBracket)
+                break;
+
+            // Get array element (packed if it can be, see ArrayNode)
+            if (node->packed() && m_lex.seek().type() == Token::Number && node->M_push(m_lex.seek()))
+                m_lex.get();
+            else
+            {
+                Node* item = M_atom();
+                if (!item)
+                    return nullptr;
+                node->impl().push_back(item);
+
+                if (node->size() == JSON_PACKED_ARRAY_THRESHOLD)
+                    node->M_pack(m_arena);
+            }
+
+            // Get comma, if needed
+            if (m_lex.seek().type() == Token::Comma)
+                m_lex.get();
+            else
+                break;
+        };
+
+        if (m_lex.seek().type() != Token::RightBracket)
+            return M_fail(Status(Status::Syntax, "expected `]' at end of array declaration", m_lex.seek()));
+        m_lex.get();
+
+        return node.release();
+    }
+    
+private:
+    Lexer& m_lex;
+    Arena* m_arena;
+    //! Errors are reported through the status, if any
+    Status* m_status = nullptr;
+    IncludeResolver* m_includes;
+    std::unique_ptr<IncludeResolver> m_ownIncludes;
+};
+
+//! A handler of the reader's events, that ignores all of them.
+//! Handlers may derive from it, and only define the events they need.
+//! Tokens (and their characters) are only valid during the calls.
+struct ReaderHandler
+{
+    void startObject(Token const&) {}
+    void key(Token const&) {}
+    void endObject(Token const&) {}
+    void startArray(Token const&) {}
+    void endArray(Token const&) {}
+    //! A number, string, boolean or null value.
+    void value(Token const&) {}
+};
+
+//! The keys of an object, scanned linearly until there are
+//!   JSON_OBJECT_INDEX_THRESHOLD of them, and then hashed.
+//! Keys that are views of the input are not copied.
+//! Used by the event reader and the streaming extractions to reject
+//!   the redefinitions that the parser rejects.
+class ObjectKeys
+{
+public:
+    //! Add a key, returns false if it was already there.
+    bool insert(Text const& key)
+    {
+        std::string_view view = key.view();
+        if (m_index.empty())
+        {
+            for (Text const& other : m_keys)
+                if (other == view)
+                    return false;
+        }
+        else if (m_index.count(view))
+            return false;
+
+        // Owned characters don't move with their Text
+        m_keys.push_back(key);
+        if (m_keys.size() == JSON_OBJECT_INDEX_THRESHOLD)
+            for (Text const& other : m_keys)
+                m_index.insert(other.view());
+        else if (!m_index.empty())
+            m_index.insert(m_keys.back().view());
+        return true;
+    }
+
+private:
+    std::vector<Text> m_keys;
+    std::unordered_set<std::string_view> m_index;
+};
+
+//! An event-based reader, that calls the handler for each structure
+//!   and value of the lexer's tokens, without building any node.
+//! Included files are read in place, as if they were part of the input.
+//! Syntax errors are the same as the parser's ones, so the keys of the
+//!   objects being read are kept to reject their redefinitions.
+template <typename H>
+class Reader
+{
+public:
+    Reader(Lexer& lex, H& handler) :
+        m_lex(lex),
+        m_handler(handler)
+    {}
+
+    //! Read a whole document (an object or an array).
+    void read()
+    {
+        Stats::Scope scope(Stats::Parsing);
+        if (m_lex.seek().type() == Token::LeftBrace)
+            return M_object(m_lex);
+
+        M_array(m_lex);
+    }
+
+    //! Read a single value, of any type.
+    void value()
+    {
+        Stats::Scope scope(Stats::Parsing);
+        M_atom(m_lex);
+    }
+
+private:
+    void M_atom(Lexer& lex)
+    {
+        Token::Type type = lex.seek().type();
+        if (type == Token::Bad)
+            throw TokenError(lex.seek(), "bad token");
+        else if (type == Token::True || type == Token::False || type == Token::Null ||
+                 type == Token::Number || type == Token::String)
+        {
+            m_handler.value(lex.seek());
+            lex.get();
+        }
+        else if (type == Token::LeftBrace)
+            M_object(lex);
+        else if (type == Token::LeftBracket)
+            M_array(lex);
+        else if (type == Token::Include)
+        {
+            Include include(lex.seek().text().str());
+            MappedFile const& map = include.map();
+
+            Lexer sub(map.data(), map.size(), true);
+            if (sub.seek().type() == Token::LeftBrace)
+                M_object(sub);
+            else
+                M_array(sub);
+            lex.get();
+        }
+        else
+            throw TokenError(lex.seek(), "unexpected token");
+    }
+
+    void M_object(Lexer& lex)
+    {
+        Stats::Nesting nesting;
+        if (lex.seek().type() != Token::LeftBrace)
+            throw TokenError(lex.seek(), "expected `{' at beginning of object declaration");
+        m_handler.startObject(lex.seek());
+        lex.get();
+
+        ObjectKeys keys;
+        for (;;)
+        {
+            // Allow empty objects
+            if (lex.seek().type() == Token::RightBrace)
+                break;
+
+            if (lex.seek().type() != Token::String)
+                throw TokenError(lex.seek(), "expected a identifier key");
+            if (!keys.insert(lex.seek().text()))
+                throw TokenError(lex.seek(), "redifinition of object entry `" + lex.seek().text().str() + "'");
+            m_handler.key(lex.seek());
+            lex.get();
+
+            if (lex.seek().type() != Token::Colon)
+                throw TokenError(lex.seek(), "expected `:' after identifier");
+            lex.get();
+
+            M_atom(lex);
+
+            if (lex.seek().type() != Token::Comma)
+                break;
+            lex.get();
+        }
+
+        if (lex.seek().type() != Token::RightBrace)
+            throw TokenError(lex.seek(), "expected `}' at end of object declaration");
+        m_handler.endObject(lex.seek());
+        lex.get();
+    }
+
+    void M_array(Lexer& lex)
+    {
+        Stats::Nesting nesting;
+        if (lex.seek().type() != Token::LeftBracket)
+            throw TokenError(lex.seek(), "expected `[' at beginning of array definition");
+        m_handler.startArray(lex.seek());
+        lex.get();
+
+        for (;;)
+        {
+            // Allow empty arrays
+            if (lex.seek().type() == Token::RightBracket)
+                break;
+
+            M_atom(lex);
+
+            if (lex.seek().type() != Token::Comma)
+                break;
+            lex.get();
+        }
+
+        if (lex.seek().type() != Token::RightBracket)
+            throw TokenError(lex.seek(), "expected `]' at end of array declaration");
+        m_handler.endArray(lex.seek());
+        lex.get();
+    }
+
+private:
+    Lexer& m_lex;
+    H& m_handler;
+};
+
+//! A query of the values at a path (a JSON pointer, such as
+//!   "/events/0/latency_ms", where "*" matches any key or index),
+//!   evaluated directly on the lexer's tokens.
+//! Only the matching values are parsed (or extracted): the other ones
+//!   are skipped by counting their brackets and braces, so that their
+//!   syntax is not checked.
+class Selector
+{
+public:
+    Selector(std::string const& path)
+    {
+        if (!path.empty() && path[0] != '/')
+            throw std::runtime_error("json::select: invalid path \"" + path + "\"");
+
+        for (std::size_t begin = 1; begin <= path.size();)
+        {
+            std::size_t end = std::min(path.find('/', begin), path.size());
+
+            // Unescape "~1" and "~0"
+            Segment segment;
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                if (path[i] == '~' && i + 1 < end && (path[i + 1] == '0' || path[i + 1] == '1'))
+                    segment.key += path[++i] == '0' ? '~' : '/';
+                else
+                    segment.key += path[i];
+            }
+
+            segment.any = segment.key == "*";
+            segment.index = -1;
+            if (!segment.key.empty() && segment.key.find_first_not_of("0123456789") == std::string::npos)
+                std::from_chars(segment.key.data(), segment.key.data() + segment.key.size(), segment.index);
+
+            m_path.push_back(std::move(segment));
+            begin = end + 1;
+        }
+    }
+
+    //! Parse the matching values of a document, which are heap-allocated
+    //!   (to be released with delete).
+    std::vector<Node*> select(Lexer& lex) const
+    {
+        Stats::Scope scope(Stats::Parsing);
+        std::vector<Node*> nodes;
+
+        try
+        {
+            M_select(lex, [&nodes](Lexer& sub)
+            {
+                Parser parser(sub);
+                nodes.push_back(parser.value());
+            });
+        }
+        catch (...)
+        {
+            for (Node* node : nodes)
+                delete node;
+            throw;
+        }
+
+        return nodes;
+    }
+
+    //! Extract each matching value of a document with the template,
+    //!   overwriting its bound values, and call the handler after each
+    //!   of them (defined below).
+    void select(Lexer& lex, Template const& tpl, std::function<void()> const& handler) const;
+
+private:
+    struct Segment
+    {
+        std::string key;
+        bool any;
+        long index;
+    };
+
+    //! Call match on each matching value of a document.
+    template <typename F>
+    void M_select(Lexer& lex, F const& match) const
+    {
+        M_document(lex);
+        M_select(lex, 0, match);
+    }
+
+    //! Check that a document begins with an object or an array.
+    static void M_document(Lexer& lex)
+    {
+        if (lex.seek().type() != Token::LeftBrace && lex.seek().type() != Token::LeftBracket)
+            throw TokenError(lex.seek(), "expected `[' at beginning of array definition");
+    }
+
+    template <typename F>
+    void M_select(Lexer& lex, std::size_t depth, F const& match) const
+    {
+        if (depth == m_path.size())
+            return match(lex);
+
+        Segment const& segment = m_path[depth];
+        Token::Type type = lex.seek().type();
+
+        if (type == Token::LeftBrace)
+        {
+            lex.get();
+            while (lex.seek().type() != Token::RightBrace)
+            {
+                if (lex.seek().type() != Token::String)
+                    throw TokenError(lex.seek(), "expected a identifier key");
+                bool matches = segment.any || lex.seek().text().view() == segment.key;
+                lex.get();
+
+                if (lex.seek().type() != Token::Colon)
+                    throw TokenError(lex.seek(), "expected `:' after identifier");
+                lex.get();
+
+                M_next(lex, depth, matches, match);
+
+                if (lex.seek().type() != Token::Comma)
+                    break;
+                lex.get();
+            }
+
+            if (lex.seek().type() != Token::RightBrace)
+                throw TokenError(lex.seek(), "expected `}' at end of object declaration");
+            lex.get();
+        }
+        else if (type == Token::LeftBracket)
+        {
+            lex.get();
+            for (long i = 0; lex.seek().type() != Token::RightBracket; ++i)
+            {
+                M_next(lex, depth, segment.any || segment.index == i, match);
+
+                if (lex.seek().type() != Token::Comma)
+                    break;
+                lex.get();
+            }
+
+            if (lex.seek().type() != Token::RightBracket)
+                throw TokenError(lex.seek(), "expected `]' at end of array declaration");
+            lex.get();
+        }
+        else if (type == Token::Include)
+        {
+            // The included document takes the place of the directive
+            //   (matched values don't refer to the file, which is unmapped
+            //   once they are parsed)
+            Include include(lex.seek().text().str());
+            MappedFile const& map = include.map();
+
+            Lexer sub(map.data(), map.size());
+            M_document(sub);
+            M_select(sub, depth, match);
+            lex.get();
+        }
+        else
+            M_skip(lex);
+    }
+
+    //! Select in an entry or element, or skip it.
+    template <typename F>
+    void M_next(Lexer& lex, std::size_t depth, bool matches, F const& match) const
+    {
+        if (matches)
+            M_select(lex, depth + 1, match);
+        else
+            M_skip(lex);
+    }
+
+    static void M_skip(Lexer& lex)
+    {
+        Token::Type type = lex.seek().type();
+        if (type == Token::Bad)
+            throw TokenError(lex.seek(), "bad token");
+        else if (type == Token::Comma || type == Token::Colon || type == Token::Eof ||
+                 type == Token::RightBrace || type == Token::RightBracket)
+            throw TokenError(lex.seek(), "unexpected token");
+
+        lex.skip();
+    }
+
+private:
+    std::vector<Segment> m_path;
+};
+
+// --------------------------------------------------------------------------------------
+// Binary encoding
+// --------------------------------------------------------------------------------------
+
+//! A compact binary encoding of node trees, to persist parsed trees and
+//!   load them back much faster than by parsing their text.
+//! The data begin with the "JSNB" magic and a version byte, followed by
+//!   the root value: a tag byte, then
+//!   - nothing for null, false and true;
+//!   - a native 64-bit signed or unsigned integer, or double, for numbers;
+//!   - a varint length and the raw bytes for strings;
+//!   - a varint count and the native 64-bit size of the entries for
+//!     objects (each entry being a key, encoded as a string without tag,
+//!     followed by a value) and arrays.
+//! The sizes of containers allow to skip them, so that values can be read
+//!   in place from the (possibly memory-mapped) data with a BinaryValue,
+//!   without decoding the whole tree.
+//! Numbers are stored in the byte order of the encoding machine.
+struct Binary
+{
+    enum Tag
+    {
+        Null,
+        False,
+        True,
+        Integer,
+        Unsigned,
+        Real,
+        String,
+        Object,
+        Array
+    };
+
+    static const unsigned char version = 1;
+
+    //! Size of the magic and version header.
+    static const std::size_t headerSize = 5;
+
+    //! Encode the tree whose root is the given node.
+    static std::string encode(Node const* node)
+    {
+        std::string out("JSNB");
+        out += static_cast<char>(version);
+        M_encode(out, node);
+        return out;
+    }
+
+    //! Decode a whole tree, allocating its nodes in the given arena if
+    //!   any (or on the heap).
+    //! If views == true, strings refer to the data instead of copying
+    //!   them, making it outlive the tree.
+    static Node* decode(const char* data, std::size_t size, Arena* arena = nullptr, bool views = false);
+
+private:
+    friend class BinaryValue;
+
+    static void M_varint(std::string& out, uint64_t value)
+    {
+        for (; value >= 0x80; value >>= 7)
+            out += static_cast<char>(value | 0x80);
+        out += static_cast<char>(value);
+    }
+
+    template <typename T>
+    static void M_native(std::string& out, T value)
+    { out.append(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+    static void M_string(std::string& out, std::string_view value)
+    {
+        M_varint(out, value.size());
+        out.append(value.data(), value.size());
+    }
+
+    //! Reserve the size of a container's entries, to be patched once
+    //!   they are encoded.
+    static std::size_t M_reserve(std::string& out)
+    {
+        out.append(sizeof(uint64_t), '\0');
+        return out.size();
+    }
+
+    static void M_patch(std::string& out, std::size_t at)
+    {
+        uint64_t size = out.size() - at;
+        std::memcpy(&out[at - sizeof(size)], &size, sizeof(size));
+    }
+
+    static void M_encode(std::string& out, Node const* node)
+    {
+        Node::Type type = node->type();
+        if (type == Node::Null)
+            out += static_cast<char>(Null);
+        else if (type == Node::Boolean)
+            out += static_cast<char>(static_cast<BooleanNode const*>(node)->value() ? True : False);
+        else if (type == Node::Number)
+        {
+            NumberNode const* number = static_cast<NumberNode const*>(node);
+            if (number->kind() == NumberNode::Integer)
+            {
+                out += static_cast<char>(Integer);
+                M_native(out, number->as<int64_t>());
+            }
+            else if (number->kind() == NumberNode::Unsigned)
+            {
+                out += static_cast<char>(Unsigned);
+                M_native(out, number->as<uint64_t>());
+            }
+            else
+            {
+                out += static_cast<char>(Real);
+                M_native(out, number->as<double>());
+            }
+        }
+        else if (type == Node::String)
+        {
+            out += static_cast<char>(String);
+            M_string(out, static_cast<StringNode const*>(node)->value());
+        }
+        else if (type == Node::Object)
+        {
+            ObjectNode const* obj = static_cast<ObjectNode const*>(node);
+            out += static_cast<char>(Object);
+            M_varint(out, obj->size());
+
+            std::size_t at = M_reserve(out);
+            for (auto const& entry : obj->impl())
+            {
+                M_string(out, entry.first.view());
+                M_encode(out, entry.second);
+            }
+            M_patch(out, at);
+        }
+        else
+        {
+            ArrayNode const* arr = static_cast<ArrayNode const*>(node);
+            out += static_cast<char>(Array);
+            M_varint(out, arr->size());
+
+            std::size_t at = M_reserve(out);
+            if (arr->packed())
+                M_encodePacked(out, *arr->m_packed);
+            else
+            {
+                for (Node const* item : arr->impl())
+                    M_encode(out, item);
+            }
+            M_patch(out, at);
+        }
+    }
+
+    //! Encode the numbers of a packed array, as their nodes would be.
+    static void M_encodePacked(std::string& out, ArrayNode::Packed const& packed)
+    {
+        for (std::size_t i = 0; i < packed.size(); ++i)
+        {
+            if (packed.kind == NumberNode::Integer)
+            {
+                out += static_cast<char>(Integer);
+                M_native(out, packed.integers[i]);
+            }
+            else if (packed.isIntegral(i))
+            {
+                out += static_cast<char>(Integer);
+                M_native(out, static_cast<int64_t>(packed.reals[i]));
+            }
+            else
+            {
+                out += static_cast<char>(Real);
+                M_native(out, packed.reals[i]);
+            }
+        }
+    }
+
+    [[noreturn]] static void M_invalid()
+    { throw std::runtime_error("json::parse_binary: invalid data"); }
+
+    static uint64_t M_varint(const char*& p, const char* end)
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (p == end)
+                break;
+
+            unsigned char byte = static_cast<unsigned char>(*p++);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+
+        M_invalid();
+    }
+
+    template <typename T>
+    static T M_native(const char*& p, const char* end)
+    {
+        if (static_cast<std::size_t>(end - p) < sizeof(T))
+            M_invalid();
+
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+
+    static std::string_view M_string(const char*& p, const char* end)
+    {
+        uint64_t size = M_varint(p, end);
+        if (size > static_cast<uint64_t>(end - p))
+            M_invalid();
+
+        std::string_view value(p, size);
+        p += size;
+        return value;
+    }
+
+    //! Read the header of a container, returning the end of its entries.
+    static const char* M_container(const char*& p, const char* end, uint64_t& count)
+    {
+        count = M_varint(p, end);
+        uint64_t size = M_native<uint64_t>(p, end);
+        if (size > static_cast<uint64_t>(end - p) || count > size)
+            M_invalid();
+        return p + size;
+    }
+
+    //! Skip the value at p, returning its end.
+    static const char* M_skip(const char* p, const char* end)
+    {
+        if (p == end)
+            M_invalid();
+
+        Tag tag = static_cast<Tag>(*p++);
+        if (tag == Null || tag == False || tag == True)
+            return p;
+        else if (tag == Integer || tag == Unsigned || tag == Real)
+        {
+            if (end - p < 8)
+                M_invalid();
+            return p + 8;
+        }
+        else if (tag == String)
+        {
+            M_string(p, end);
+            return p;
+        }
+        else if (tag == Object || tag == Array)
+        {
+            uint64_t count;
+            return M_container(p, end, count);
+        }
+
+        M_invalid();
+    }
+
+    //! Create a new node (in the arena if any).
+    template <typename T, typename... Args>
+    static T* M_make(Arena* arena, Args&&... args)
+    {
+        T* node = arena ? arena->make<T>(std::forward<Args>(args)...) : new T(std::forward<Args>(args)...);
+        Stats::node(node);
+        return node;
+    }
+
+    static Text M_text(std::string_view chars, Arena* arena, bool views)
+    {
+        if (views)
+            return Text::reference(chars);
+        else if (arena)
+            return arena->intern(chars);
+        return Text(std::string(chars));
+    }
+
+    //! Releases nodes on errors, unless they belong to the arena.
+    struct Release
+    {
+        bool heap;
+        void operator()(Node* node) const { if (heap) delete node; }
+    };
+
+    static Node* M_decode(const char*& p, const char* end, Arena* arena, bool views)
+    {
+        if (p == end)
+            M_invalid();
+
+        Tag tag = static_cast<Tag>(*p++);
+        if (tag == Null)
+            return M_make<NullNode>(arena);
+        else if (tag == False || tag == True)
+            return M_make<BooleanNode>(arena, tag == True);
+        else if (tag == Integer)
+            return M_make<NumberNode>(arena, M_native<int64_t>(p, end));
+        else if (tag == Unsigned)
+            return M_make<NumberNode>(arena, M_native<uint64_t>(p, end));
+        else if (tag == Real)
+            return M_make<NumberNode>(arena, M_native<double>(p, end));
+        else if (tag == String)
+            return M_make<StringNode>(arena, M_text(M_string(p, end), arena, views));
+        else if (tag == Object)
+        {
+            uint64_t count;
+            const char* last = M_container(p, end, count);
+
+            Stats::Nesting nesting;
+            std::unique_ptr<ObjectNode, Release> node(M_make<ObjectNode>(arena, Token(),
+                arena ? arena->resource() : std::pmr::get_default_resource()), Release{!arena});
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                std::string_view key = M_string(p, last);
+                std::unique_ptr<Node, Release> value(M_decode(p, last, arena, views), Release{!arena});
+                if (!node->insert(M_text(key, arena, views), value.get()))
+                    M_invalid();
+                value.release();
+            }
+
+            if (p != last)
+                M_invalid();
+            return node.release();
+        }
+        else if (tag == Array)
+        {
+            uint64_t count;
+            const char* last = M_container(p, end, count);
+
+            Stats::Nesting nesting;
+            std::unique_ptr<ArrayNode, Release> node(M_make<ArrayNode>(arena, Token(),
+                arena ? arena->resource() : std::pmr::get_default_resource()), Release{!arena});
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                // Numbers are packed as the parser does (see ArrayNode)
+                if (node->packed() && p != last && (*p == Integer || *p == Real))
+                {
+                    const char* next = p + 1;
+                    if (*p == Integer ? node->M_push(M_native<int64_t>(next, last)) :
+                                        node->M_push(M_native<double>(next, last)))
+                    {
+                        p = next;
+                        continue;
+                    }
+                }
+
+                node->impl().push_back(M_decode(p, last, arena, views));
+                if (node->size() == JSON_PACKED_ARRAY_THRESHOLD)
+                    node->M_pack(arena);
+            }
+
+            if (p != last)
+                M_invalid();
+            return node.release();
+        }
+
+        M_invalid();
+    }
+
+    //! Check the header, returning the beginning of the root value.
+    static const char* M_header(const char* data, std::size_t size)
+    {
+        if (size < headerSize || std::memcmp(data, "JSNB", 4) != 0)
+            M_invalid();
+        if (static_cast<unsigned char>(data[4]) != version)
+            throw std::runtime_error("json::parse_binary: unsupported version");
+        return data + headerSize;
+    }
+};
+
+//! A value of binary encoded data (see Binary), read in place: objects
+//!   and arrays are only scanned up to the entries looked for, skipping
+//!   the other ones by their encoded size.
+//! Values are valid for as long as the data, and invalid data throw
+//!   std::runtime_error when read.
+class BinaryValue
+{
+public:
+    BinaryValue() : m_data(nullptr), m_end(nullptr) {}
+
+    //! Get the root value of encoded data (checking their header).
+    BinaryValue(const char* data, std::size_t size) :
+        m_data(Binary::M_header(data, size)),
+        m_end(data + size)
+    {}
+
+    //! Tell if the handle refers to a value.
+    explicit operator bool() const
+    { return m_data != nullptr; }
+
+    Node::Type type() const
+    {
+        Binary::Tag tag = M_tag();
+        if (tag == Binary::Null) return Node::Null;
+        else if (tag == Binary::False || tag == Binary::True) return Node::Boolean;
+        else if (tag == Binary::String) return Node::String;
+        else if (tag == Binary::Object) return Node::Object;
+        else if (tag == Binary::Array) return Node::Array;
+        return Node::Number;
+    }
+
+    //! Get the value of a number (or boolean), converted to the given
+    //!   arithmetic type.
+    template <typename T>
+    T as() const
+    {
+        Binary::Tag tag = M_tag();
+        const char* p = m_data + 1;
+        if (tag == Binary::Integer)
+            return static_cast<T>(Binary::M_native<int64_t>(p, m_end));
+        else if (tag == Binary::Unsigned)
+            return static_cast<T>(Binary::M_native<uint64_t>(p, m_end));
+        else if (tag == Binary::Real)
+            return static_cast<T>(Binary::M_native<double>(p, m_end));
+        else if (tag == Binary::False || tag == Binary::True)
+            return static_cast<T>(tag == Binary::True);
+
+        throw std::domain_error("json::BinaryValue::as: not a number");
+    }
+
+    //! Get the value of a string, referring to the data.
+    std::string_view string() const
+    {
+        if (M_tag() != Binary::String)
+            throw std::domain_error("json::BinaryValue::string: not a string");
+
+        const char* p = m_data + 1;
+        return Binary::M_string(p, m_end);
+    }
+
+    //! Get the number of entries of an object, or elements of an array
+    //!   (and 0 for other values).
+    std::size_t size() const
+    {
+        uint64_t count = 0;
+        M_entries(count);
+        return count;
+    }
+
+    bool exists(std::string_view key) const
+    { return static_cast<bool>(find(key)); }
+
+    //! Get the value of an object entry (or an empty handle).
+    BinaryValue find(std::string_view key) const
+    {
+        if (M_tag() != Binary::Object)
+            return BinaryValue();
+
+        uint64_t count = 0;
+        const char* p = nullptr;
+        const char* end = M_entries(count, &p);
+        for (; count > 0; --count)
+        {
+            if (Binary::M_string(p, end) == key)
+                return BinaryValue(p, end);
+            p = Binary::M_skip(p, end);
+        }
+
+        return BinaryValue();
+    }
+
+    //! Same as above, throwing if the entry doesn't exist.
+    BinaryValue get(std::string_view key) const
+    {
+        BinaryValue value = find(key);
+        if (!value) throw std::out_of_range("json::BinaryValue::get: no such key");
+        return value;
+    }
+
+    //! Get the element of an array, or the value of the i-th entry of an object.
+    BinaryValue at(std::size_t i) const
+    {
+        const char* end;
+        const char* p = M_entry(i, end);
+        if (M_tag() == Binary::Object)
+            Binary::M_string(p, end);
+        return BinaryValue(p, end);
+    }
+
+    //! Get the key of the i-th entry of an object.
+    std::string_view key(std::size_t i) const
+    {
+        if (M_tag() != Binary::Object)
+            throw std::domain_error("json::BinaryValue::key: not an object");
+
+        const char* end;
+        const char* p = M_entry(i, end);
+        return Binary::M_string(p, end);
+    }
+
+    //! Decode the value (and its children), allocating its nodes in the
+    //!   given arena if any (or on the heap).
+    //! If views == true, strings refer to the data.
+    Node* node(Arena* arena = nullptr, bool views = false) const
+    {
+        const char* p = m_data;
+        return Binary::M_decode(p, m_end, arena, views);
+    }
+
+private:
+    BinaryValue(const char* data, const char* end) : m_data(data), m_end(end) {}
+
+    Binary::Tag M_tag() const
+    {
+        if (!m_data || m_data == m_end)
+            Binary::M_invalid();
+        return static_cast<Binary::Tag>(*m_data);
+    }
+
+    //! Get the count of entries of a container, and where they begin
+    //!   (returns their end, or nullptr for other values).
+    const char* M_entries(uint64_t& count, const char** begin = nullptr) const
+    {
+        Binary::Tag tag = M_tag();
+        if (tag != Binary::Object && tag != Binary::Array)
+            return nullptr;
+
+        const char* p = m_data + 1;
+        const char* end = Binary::M_container(p, m_end, count);
+        if (begin)
+            *begin = p;
+        return end;
+    }
+
+    //! Get the i-th entry of a container, and the end of the entries.
+    const char* M_entry(std::size_t i, const char*& end) const
+    {
+        uint64_t count = 0;
+        const char* p = nullptr;
+        end = M_entries(count, &p);
+        if (i >= count) throw std::domain_error("json::BinaryValue::at: index out of bounds");
+
+        bool object = M_tag() == Binary::Object;
+        for (; i > 0; --i)
+        {
+            if (object)
+                Binary::M_string(p, end);
+            p = Binary::M_skip(p, end);
+        }
+        return p;
+    }
+
+private:
+    //! Tag of the value, and end of the enclosing data
+    const char* m_data;
+    const char* m_end;
+};
+
+inline Node* Binary::decode(const char* data, std::size_t size, Arena* arena, bool views)
+{
+    Stats::Scope scope(Stats::Parsing);
+    const char* p = M_header(data, size);
+    const char* end = data + size;
+
+    Node* root = M_decode(p, end, arena, views);
+    if (p != end)
+    {
+        if (!arena)
+            delete root;
+        M_invalid();
+    }
+
+    return root;
+}
+
+// --------------------------------------------------------------------------------------
+// Documents
+// --------------------------------------------------------------------------------------
+
+//! A parsed document, owning the resources its node tree refers to.
+//! All the nodes of the document are allocated in its arena, and thus
+//!   released at once with the document (they must never be deleted).
+class Document
+{
+public:
+    Document() : m_root(nullptr) {}
+    ~Document() { reset(); }
+
+    Document(Document const&) = delete;
+    Document& operator=(Document const&) = delete;
+
+    //! Parse a file, which is kept memory-mapped for as long as the
+    //!   document lives.
+    //! Object keys and string values without escape sequences are not
+    //!   copied, but refer directly to the mapped file.
+    Node* parse(std::string const& file, IncludeResolver* includes = nullptr)
+    {
+        reset();
+
+        if (!m_file.open(file))
+            throw std::runtime_error("json::Document::parse: unable to open \"" + file + "\"");
+
+        Lexer lexer(m_file.data(), m_file.size(), true);
+        return M_parse(lexer, includes);
+    }
+
+    //! Parse an input stream.
+    Node* parse(std::istream& in, IncludeResolver* includes = nullptr)
+    {
+        reset();
+
+        Lexer lexer(in);
+        return M_parse(lexer, includes);
+    }
+
+    //! Parse a buffer (its characters are copied in the document).
+    Node* parse(const char* data, std::size_t size, IncludeResolver* includes = nullptr)
+    {
+        reset();
+
+        Lexer lexer(data, size);
+        return M_parse(lexer, includes);
+    }
+
+    //! Parse a file whose root is a large array, parsing parts of this
+    //!   array concurrently with the given number of threads (by default
+    //!   one per hardware thread), each of them in its own arena.
+    //! The threads are created for each call (there is no pool), which
+    //!   is only worth it for large documents.
+    //! Documents whose root is not an array are parsed as usual.
+    Node* parseParallel(std::string const& file, unsigned threads = 0)
+    {
+        reset();
+
+        if (!m_file.open(file))
+            throw std::runtime_error("json::Document::parse: unable to open \"" + file + "\"");
+
+        return M_parseParallel(m_file.data(), m_file.size(), true, threads);
+    }
+
+    //! Same as above, for a buffer (its characters are copied in the document).
+    Node* parseParallel(const char* data, std::size_t size, unsigned threads = 0)
+    {
+        reset();
+        return M_parseParallel(data, size, false, threads);
+    }
+
+    //! Load a binary encoded file (see Binary), which is kept memory-mapped
+    //!   for as long as the document lives (and strings refer to it).
+    Node* parseBinary(std::string const& file)
+    {
+        reset();
+
+        if (!m_file.open(file))
+            throw std::runtime_error("json::Document::parseBinary: unable to open \"" + file + "\"");
+
+        m_root = Binary::decode(m_file.data(), m_file.size(), &m_arena, true);
+        return m_root;
+    }
+
+    //! Same as above, for a buffer (its characters are copied in the document).
+    Node* parseBinary(const char* data, std::size_t size)
+    {
+        reset();
+
+        m_root = Binary::decode(data, size, &m_arena);
+        return m_root;
+    }
+
+    //! Get the root of the document tree (or nullptr if nothing is parsed).
+    Node* root()
+    { return m_root; }
+
+    //! Same as above, read-only: a const document may be read by several
+    //!   threads at once (see SharedDocument).
+    Node const* root() const
+    { return m_root; }
+
+    //! Get the arena of the document, in which nodes added to its
+    //!   tree must be allocated.
+    Arena& arena()
+    { return m_arena; }
+
+    //! Release the node tree, and the resources it refers to.
+    void reset()
+    {
+        m_root = nullptr;
+        m_arena.release();
+        m_arenas.clear();
+        m_file.close();
+    }
+
+private:
+    //! A part of the root array, holding whole elements.
+    struct Range
+    {
+        std::size_t begin, end;
+        Token::Info at;
+    };
+    Node* M_parse(Lexer& lexer, IncludeResolver* includes)
+    {
+        Parser parser(lexer, &m_arena, includes);
+        m_root = parser.parse();
+        return m_root;
+    }
+
+    Node* M_parseParallel(const char* data, std::size_t size, bool views, unsigned threads)
+    {
+        if (!threads)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        Lexer lexer(data, size, views);
+        std::vector<Range> ranges;
+        if (threads < 2 || lexer.seek().type() != Token::LeftBracket ||
+            !M_split(data, size, lexer.seek().info().offset, 4 * threads, ranges))
+        {
+            return M_parse(lexer, nullptr);
+        }
+
+        // Statistics of the worker threads are merged into this one's
+        Stats::Scope scope(Stats::Parsing);
+        Stats* stats = Stats::current();
+        std::vector<Stats> collected(stats ? threads : 0);
+
+        // Parse the ranges, each of them in its own arena
+        std::vector<std::vector<Node*>> items(ranges.size());
+        std::vector<std::exception_ptr> errors(ranges.size());
+        for (std::size_t i = 0; i < ranges.size(); ++i)
+            m_arenas.push_back(std::make_unique<Arena>());
+
+        std::atomic<std::size_t> next(0);
+        auto work = [&](Stats* into)
+        {
+            Stats::Scope scope(Stats::Parsing, into);
+            for (std::size_t i; (i = next++) < ranges.size();)
+            {
+                try
+                {
+                    Range const& range = ranges[i];
+                    Lexer sub(data + range.begin, range.end - range.begin, views, range.at);
+                    Parser parser(sub, m_arenas[i].get());
+
+                    for (;;)
+                    {
+                        // Allow a trailing comma, as at the end of an array
+                        if (i + 1 == ranges.size() && sub.seek().type() == Token::Eof)
+                            break;
+
+                        items[i].push_back(parser.value());
+                        if (sub.seek().type() != Token::Comma)
+                            break;
+                        sub.get();
+                    }
+
+                    if (sub.seek().type() != Token::Eof)
+                        throw TokenError(sub.seek(), "expected `]' at end of array declaration");
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            }
+        };
+
+        // This thread works too, along with the ones created for the call
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads; ++t)
+            workers.emplace_back(work, stats ? &collected[t] : nullptr);
+        work(nullptr);
+        for (auto& thread : workers)
+            thread.join();
+
+        for (Stats const& other : collected)
+            *stats += other;
+
+        // Errors are reported as a sequential parse would do
+        for (auto const& error : errors)
+        {
+            if (error)
+            {
+                m_arenas.clear();
+                return M_parse(lexer, nullptr);
+            }
+        }
+
+        ArrayNode* root = m_arena.make<ArrayNode>(lexer.seek(), m_arena.resource());
+        Stats::node(root);
+        std::size_t count = 0;
+        for (auto const& part : items)
+            count += part.size();
+
+        root->impl().reserve(count);
+        for (auto const& part : items)
+            root->impl().insert(root->impl().end(), part.begin(), part.end());
+
+        m_root = root;
+        return m_root;
+    }
+
+    //! Split the root array beginning at the given offset into about the
+    //!   given number of ranges, by scanning its structure (strings,
+    //!   includes and comments included).
+    //! Returns false if the array can't be split.
+    static bool M_split(const char* data, std::size_t size, std::size_t begin,
+                        std::size_t count, std::vector<Range>& ranges)
+    {
+        std::size_t step = std::max<std::size_t>((size - begin) / count, 1);
+        std::size_t target = begin + step;
+
+        // Position of the first element
+        Range range;
+        range.begin = begin + 1;
+        range.at.empty = false;
+
+        int line = 1;
+        std::size_t lineStart = 0;
+        for (std::size_t i = 0; i < begin; ++i)
+        {
+            if (data[i] == '\n')
+            {
+                ++line;
+                lineStart = i + 1;
+            }
+        }
+
+        auto mark = [&](std::size_t at)
+        {
+            range.at.line = line;
+            range.at.offset = at;
+            range.at.column = static_cast<int>(at - lineStart) + 1;
+        };
+        mark(range.begin);
+
+        int depth = 0;
+        for (std::size_t i = begin; i < size; ++i)
+        {
+            char ch = data[i];
+
+            if (ch == '\n')
+            {
+                ++line;
+                lineStart = i + 1;
+            }
+            else if (ch == '"' || (ch == '@' && i + 1 < size && data[i + 1] == '"'))
+            {
+                // Include paths have no escape sequences
+                bool escapes = ch == '"';
+                if (!escapes)
+                    ++i;
+
+                for (++i; i < size && data[i] != '"'; ++i)
+                {
+                    if (escapes && data[i] == '\\')
+                        ++i;
+                    else if (data[i] == '\n')
+                    {
+                        ++line;
+                        lineStart = i + 1;
+                    }
+                }
+            }
+            else if (ch == '#')
+            {
+                while (i + 1 < size && data[i + 1] != '\n')
+                    ++i;
+            }
+            else if (ch == '[' || ch == '{')
+                ++depth;
+            else if (ch == ']' || ch == '}')
+            {
+                if (--depth > 0)
+                    continue;
+
+                // End of the root array
+                if (depth < 0 || ch != ']')
+                    return false;
+
+                range.end = i;
+                ranges.push_back(range);
+                return ranges.size() > 1;
+            }
+            else if (ch == ',' && depth == 1 && i >= target)
+            {
+                range.end = i;
+                ranges.push_back(range);
+
+                range.begin = i + 1;
+                mark(range.begin);
+                target = i + step;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    MappedFile m_file;
+    Arena m_arena;
+    //! Arenas of the parts of the tree parsed concurrently
+    std::vector<std::unique_ptr<Arena>> m_arenas;
+    Node* m_root;
+};
+
+#if defined(__cpp_lib_atomic_shared_ptr)
+# define JSON_ATOMIC_SHARED_PTR 1
+#else
+# define JSON_ATOMIC_SHARED_PTR 0
+#endif
+
+//! A document read by concurrent threads, and replaced as a whole (for
+//!   instance when its file is reloaded).
+//! Readers get snapshots: const documents that stay valid and unchanged
+//!   for as long as they hold them, even once newer ones are published,
+//!   and that are freed when their last reader drops them.
+//! Publishing never waits for the readers, which only wait for the copy
+//!   of a shared pointer (through std::atomic<std::shared_ptr> if the
+//!   library has it, C++20).
+class SharedDocument
+{
+public:
+    typedef std::shared_ptr<Document const> Snapshot;
+
+public:
+    SharedDocument()
+    {}
+
+    SharedDocument(SharedDocument const&) = delete;
+    SharedDocument& operator=(SharedDocument const&) = delete;
+
+    //! Get the current snapshot (or nullptr if none is published).
+    Snapshot snapshot() const
+    {
+#if JSON_ATOMIC_SHARED_PTR
+        return m_current.load(std::memory_order_acquire);
+#else
+        return std::atomic_load_explicit(&m_current, std::memory_order_acquire);
+#endif
+    }
+
+    //! Publish a document to the readers getting a snapshot from now on
+    //!   (it must not be modified anymore).
+    void publish(Snapshot document)
+    {
+#if JSON_ATOMIC_SHARED_PTR
+        m_current.store(std::move(document), std::memory_order_release);
+#else
+        std::atomic_store_explicit(&m_current, std::move(document), std::memory_order_release);
+#endif
+    }
+
+    //! Parse a file to a new document, and publish it (on errors, the
+    //!   current snapshot is left published).
+    //! The file is read rather than memory-mapped, as it may be rewritten
+    //!   while older snapshots are still read.
+    Snapshot reload(std::string const& file, IncludeResolver* includes = nullptr)
+    {
+        std::ifstream in(file, std::ios::binary);
+        if (!in)
+            throw std::runtime_error("json::SharedDocument::reload: unable to open \"" + file + "\"");
+
+        std::shared_ptr<Document> document = std::make_shared<Document>();
+        document->parse(in, includes);
+        publish(document);
+        return document;
+    }
+
+private:
+#if JSON_ATOMIC_SHARED_PTR
+    std::atomic<Snapshot> m_current;
+#else
+    Snapshot m_current;
+#endif
+};
+
+//! Resolves the include directives of parsed documents, caching
+//!   the included files.
+//! Files are identified by their canonical path, and each of them is
+//!   parsed once for as long as neither it nor the files it includes
+//!   are modified (which is checked through their modification time),
+//!   so that a resolver can be kept across reloads.
+//! Node trees own their nodes, so include sites get copies of the
+//!   cached trees rather than the trees themselves.
+class IncludeResolver
+{
+public:
+    IncludeResolver() {}
+
+    IncludeResolver(IncludeResolver const&) = delete;
+    IncludeResolver& operator=(IncludeResolver const&) = delete;
+
+    //! Get the tree of an included file, which is owned by the
+    //!   resolver (and valid until the file is resolved again
+    //!   after being modified, or until the resolver is cleared).
+    Node const* resolve(std::string const& file)
+    {
+        Stats::Scope scope(Stats::Including);
+        std::string path = Include::canonical(file);
+        Entry* entry = M_entry(path);
+
+        // The file being parsed depends on this one, and on its includes
+        //   (each of them being checked once, however many times it's included)
+        if (!m_parsing.empty())
+        {
+            Entry* parent = m_parsing.back();
+            parent->depends.emplace(path, entry->mtime);
+            parent->depends.insert(entry->depends.begin(), entry->depends.end());
+        }
+
+        return entry->doc.root();
+    }
+
+    //! Drop all the cached trees.
+    void clear()
+    { m_cache.clear(); }
+
+private:
+    typedef std::filesystem::file_time_type Time;
+
+    struct Entry
+    {
+        Time mtime;
+        Document doc;
+        //! Included files (recursively), and their modification times
+        std::map<std::string, Time> depends;
+    };
+
+    static Time M_mtime(std::string const& path)
+    {
+        std::error_code ec;
+        Time mtime = std::filesystem::last_write_time(path, ec);
+        return ec ? Time::min() : mtime;
+    }
+
+    //! Tell if a cached file, or one of its includes, was modified.
+    static bool M_modified(Entry const& entry, std::string const& path)
+    {
+        if (M_mtime(path) != entry.mtime)
+            return true;
+
+        for (auto const& dep : entry.depends)
+            if (M_mtime(dep.first) != dep.second)
+                return true;
+
+        return false;
+    }
+
+    //! Get the entry of a file, parsing it if needed.
+    Entry* M_entry(std::string const& path)
+    {
+        // Throws on include cycles
+        Include include(path);
+
+        std::unique_ptr<Entry>& entry = m_cache[path];
+        if (entry && !M_modified(*entry, path))
+            return entry.get();
+
+#if JSON_STATS
+        if (Stats* stats = Stats::current())
+            ++stats->includes;
+#endif
+        entry = std::make_unique<Entry>();
+        entry->mtime = M_mtime(path);
+        m_parsing.push_back(entry.get());
+
+        try
+        {
+            entry->doc.parse(path, this);
+        }
+        catch (...)
+        {
+            m_parsing.pop_back();
+            m_cache.erase(path);
+            throw;
+        }
+
+        m_parsing.pop_back();
+        return entry.get();
+    }
+
+private:
+    std::map<std::string, std::unique_ptr<Entry>> m_cache;
+    //! Files being parsed, outermost first
+    std::vector<Entry*> m_parsing;
+};
+
+//! A reader of a stream of documents (such as newline-delimited JSON),
+//!   that yields them one at a time from a single lexer.
+//! Only the current document is held in memory, so that the stream may
+//!   be arbitrarily long (or never end), and the reader never waits for
+//!   the next document before it is asked for.
+//! After an error, the position in the stream is unspecified.
+class StreamReader
+{
+public:
+    StreamReader(std::istream& in) :
+        m_lex(in, true),
+        m_root(nullptr)
+    {}
+
+    StreamReader(StreamReader const&) = delete;
+    StreamReader& operator=(StreamReader const&) = delete;
+
+    //! Parse the next document (which may be any value), releasing the
+    //!   previous one, or return nullptr at the end of the stream.
+    Node* next()
+    {
+        m_root = nullptr;
+        m_arena.release();
+
+        if (m_lex.seek().type() == Token::Eof)
+            return nullptr;
+
+        Parser parser(m_lex, &m_arena, &m_includes);
+        m_root = parser.value();
+        return m_root;
+    }
+
+    //! Extract the next document directly from its tokens, overwriting
+    //!   the bound values, or return false at the end of the stream
+    //!   (defined below).
+    bool extract(Template const& tpl);
+    bool extract(Plan const& plan);
+
+    //! Get the current document (or nullptr).
+    Node* root() const
+    { return m_root; }
+
+private:
+    Lexer m_lex;
+    Arena m_arena;
+    //! Included files are cached for all the documents
+    IncludeResolver m_includes;
+    Node* m_root;
+};
+
+//! A push parser, fed with chunks of characters as they arrive (such as
+//!   from non-blocking sockets), that never waits for more input.
+//! Its state is kept across chunks, even in the middle of a token, and
+//!   each time a top-level value (of any type) is complete, it is given
+//!   to the handler.
+//! Only the characters of the tokens split across chunks are buffered:
+//!   the nodes of the current value are built as its tokens arrive (in an
+//!   arena released once the next value begins, so that the nodes of the
+//!   errors thrown while handling a value remain valid until then).
+//! After an error, the parser must be reset.
+class PushParser
+{
+public:
+    //! Called with each complete value (which is valid during the call only).
+    typedef std::function<void(Node*)> Handler;
+
+    PushParser(Handler handler) :
+        m_handler(std::move(handler))
+    { reset(); }
+
+    //! Extract each complete value with the template, overwriting its
+    //!   bound values, then call the handler (defined below).
+    PushParser(Template const& tpl, Handler handler);
+
+    PushParser(PushParser const&) = delete;
+    PushParser& operator=(PushParser const&) = delete;
+
+    //! Parse a chunk of characters (which needs not outlive the call).
+    void feed(const char* data, std::size_t size)
+    {
+        Stats::Scope scope(Stats::Parsing);
+        const char* end = data + size;
+
+        // Complete tokens are lexed by runs, from the chunk itself
+        const char* run = data;
+        Token::Info at = M_info(data, data);
+        const char* start = data;
+        bool carried = m_state != Idle;
+
+        // Lex a token begun in a previous chunk, once it is complete
+        auto complete = [&](const char* p)
+        {
+            if (carried)
+            {
+                if (m_state != Comment)
+                {
+                    m_partial.append(data, p);
+                    M_lex(m_partial.data(), m_partial.size(), m_at);
+                    m_partial.clear();
+                }
+
+                carried = false;
+                run = p;
+                at = M_info(data, p);
+            }
+            m_state = Idle;
+        };
+
+        auto begin = [&](State state, const char* p)
+        {
+            m_state = state;
+            m_at = M_info(data, p);
+            start = p;
+        };
+
+        for (const char* p = data; p != end;)
+        {
+            char ch = *p;
+            switch (m_state)
+            {
+            case Idle:
+                if (ch == '"')
+                    begin(String, p);
+                else if (ch == '@')
+                    begin(Include, p);
+                else if (ch == '#')
+                    begin(Comment, p);
+                else if (M_isWord(ch))
+                    begin(Word, p);
+                break;
+
+            case Word:
+                // The character after a word is not part of it
+                if (!M_isWord(ch))
+                {
+                    complete(p);
+                    continue;
+                }
+                break;
+
+            case String:
+                if (ch == '\\')
+                    m_state = Escape;
+                else if (ch == '"')
+                    complete(p + 1);
+                break;
+
+            case Escape:
+                m_state = String;
+                break;
+
+            case Include:
+                if (ch != '"')
+                {
+                    complete(p);
+                    continue;
+                }
+                m_state = IncludeString;
+                break;
+
+            case IncludeString:
+                if (ch == '"')
+                    complete(p + 1);
+                break;
+
+            case Comment:
+                if (ch == '\n')
+                    complete(p);
+                break;
+            }
+
+            if (ch == '\n')
+            {
+                ++m_line;
+                m_lineStart = m_base + (p - data) + 1;
+            }
+            ++p;
+        }
+
+        // Keep the characters of the last token if it's not complete
+        if (carried)
+        {
+            if (m_state != Comment)
+                m_partial.append(data, end);
+        }
+        else if (m_state != Idle)
+        {
+            M_lex(run, start - run, at);
+            if (m_state != Comment)
+                m_partial.assign(start, end);
+        }
+        else
+            M_lex(run, end - run, at);
+
+        m_base += size;
+    }
+
+    //! Signal the end of the input, throwing if a value is incomplete.
+    void finish()
+    {
+        Stats::Scope scope(Stats::Parsing);
+        if (m_state != Idle && m_state != Comment)
+            M_lex(m_partial.data(), m_partial.size(), m_at);
+        m_partial.clear();
+        m_state = Idle;
+
+        if (!m_stack.empty())
+        {
+            Token eof = Token::Eof;
+            eof.setInfo(M_info(nullptr, nullptr));
+            M_push(eof);
+        }
+    }
+
+    //! Discard the current value, and start a new input.
+    void reset()
+    {
+        m_stack.clear();
+        m_arena.release();
+        m_handled = false;
+
+        m_state = Idle;
+        m_partial.clear();
+        m_base = 0;
+        m_line = 1;
+        m_lineStart = 0;
+    }
+
+private:
+    //! Where the scanner is, relatively to tokens.
+    enum State
+    {
+        Idle,
+        Word,
+        String,
+        Escape,
+        Include,
+        IncludeString,
+        Comment
+    };
+
+    //! An object or array being parsed.
+    struct Frame
+    {
+        enum Expect
+        {
+            Entry,
+            Colon,
+            Value,
+            Next
+        };
+
+        Node* node;
+        Expect expect;
+        Token key;
+    };
+
+    //! Characters of numbers and keywords (a superset of them, so that
+    //!   the lexer decides where they end).
+    static bool M_isWord(char ch)
+    {
+        return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+               ch == '-' || ch == '+' || ch == '.' || ch == '_';
+    }
+
+    //! Get the stream information for a position in the current chunk.
+    Token::Info M_info(const char* data, const char* at) const
+    {
+        Token::Info info;
+        info.empty = false;
+        info.offset = m_base + (at - data);
+        info.line = m_line;
+        info.column = static_cast<int>(info.offset - m_lineStart) + 1;
+        return info;
+    }
+
+    //! Lex complete tokens, and parse them.
+    void M_lex(const char* data, std::size_t size, Token::Info const& at)
+    {
+        if (!size)
+            return;
+
+        Lexer lex(data, size, false, at);
+        while (lex.seek().type() != Token::Eof)
+            M_push(lex.get());
+    }
+
+    Token M_token(Token const& token)
+    {
+        if (!token.text().owned())
+            return token;
+
+        Token interned(token.type(), m_arena.intern(token.text().view()), token.flags());
+        interned.setInfo(token.info());
+        return interned;
+    }
+
+    //! Create a new node in the arena.
+    template <typename T, typename... Args>
+    T* M_make(Args&&... args)
+    {
+        T* node = m_arena.make<T>(std::forward<Args>(args)...);
+        Stats::node(node);
+        return node;
+    }
+
+    //! Parse the next token (as the Parser would do).
+    void M_push(Token const& token)
+    {
+        Token::Type type = token.type();
+
+        // Release the previous value once the next one begins
+        if (m_handled && m_stack.empty())
+        {
+            m_arena.release();
+            m_handled = false;
+        }
+
+        if (!m_stack.empty())
+        {
+            Frame& top = m_stack.back();
+            bool object = top.node->type() == Node::Object;
+            Token::Type close = object ? Token::RightBrace : Token::RightBracket;
+
+            if (top.expect == Frame::Entry)
+            {
+                // Allow empty objects and arrays
+                if (type == close)
+                    return M_close();
+
+                if (object)
+                {
+                    if (type != Token::String)
+                        throw TokenError(token, "expected a identifier key");
+
+                    top.key = token;
+                    top.expect = Frame::Colon;
+                    return;
+                }
+            }
+            else if (top.expect == Frame::Colon)
+            {
+                if (type != Token::Colon)
+                    throw TokenError(token, "expected `:' after identifier");
+
+                top.expect = Frame::Value;
+                return;
+            }
+            else if (top.expect == Frame::Next)
+            {
+                if (type == Token::Comma)
+                {
+                    top.expect = Frame::Entry;
+                    return;
+                }
+
+                if (type != close)
+                {
+                    throw TokenError(token, object ? "expected `}' at end of object declaration" :
+                                                     "expected `]' at end of array declaration");
+                }
+
+                return M_close();
+            }
+        }
+
+        // Values
+        if (type == Token::Bad)
+            throw TokenError(token, "bad token");
+        else if (type == Token::True || type == Token::False)
+            M_value(M_make<BooleanNode>(type == Token::True, token));
+        else if (type == Token::Null)
+            M_value(M_make<NullNode>(token));
+        else if (type == Token::Number)
+        {
+            // Numbers are packed as the parser does (see ArrayNode)
+            ArrayNode* packed = m_stack.empty() ? nullptr : m_stack.back().node->downcast<ArrayNode>();
+            if (packed && packed->packed() && packed->M_push(token))
+                m_stack.back().expect = Frame::Next;
+            else
+                M_value(M_make<NumberNode>(token));
+        }
+        else if (type == Token::String)
+        {
+            Token interned = M_token(token);
+            M_value(M_make<StringNode>(interned.text(), interned));
+        }
+        else if (type == Token::LeftBrace)
+            m_stack.push_back(Frame{M_make<ObjectNode>(token, m_arena.resource()), Frame::Entry, Token()});
+        else if (type == Token::LeftBracket)
+            m_stack.push_back(Frame{M_make<ArrayNode>(token, m_arena.resource()), Frame::Entry, Token()});
+        else if (type == Token::Include)
+            M_value(m_includes.resolve(token.text().str())->clone(&m_arena));
+        else
+            throw TokenError(token, "unexpected token");
+    }
+
+    //! Close the innermost object or array.
+    void M_close()
+    {
+        Node* node = m_stack.back().node;
+        m_stack.pop_back();
+        M_value(node);
+    }
+
+    //! Add a complete value to its parent, or handle it.
+    void M_value(Node* node)
+    {
+        if (m_stack.empty())
+        {
+            m_handled = true;
+            return m_handler(node);
+        }
+
+        Frame& top = m_stack.back();
+        if (top.node->type() == Node::Object)
+        {
+            ObjectNode* object = static_cast<ObjectNode*>(top.node);
+            if (!object->insert(m_arena.intern(top.key.text().view()), node))
+                throw TokenError(top.key, "redifinition of object entry `" + top.key.text().str() + "'");
+        }
+        else
+        {
+            ArrayNode* array = static_cast<ArrayNode*>(top.node);
+            array->impl().push_back(node);
+            if (array->size() == JSON_PACKED_ARRAY_THRESHOLD)
+                array->M_pack(&m_arena);
+        }
+
+        top.expect = Frame::Next;
+    }
+
+private:
+    Handler m_handler;
+    Arena m_arena;
+    IncludeResolver m_includes;
+    std::vector<Frame> m_stack;
+    //! Whether the arena holds a value that was already handled
+    bool m_handled;
+
+    //! State of the scanner, and characters of a token split across chunks
+    State m_state;
+    std::string m_partial;
+    Token::Info m_at;
+
+    //! Absolute offset of the current chunk, and position of its
+    //!   current line
+    std::size_t m_base;
+    int m_line;
+    std::size_t m_lineStart;
+};
+
+//! A value of a lazy document, that is only parsed when its node is
+//!   asked for (and then cached).
+//! Objects and arrays can be walked without parsing them, through
+//!   their structural index.
+//! Handles are valid for as long as their document is not reset, and
+//!   the accessors of an empty handle return an empty handle, Node::Null,
+//!   0 or nullptr, so that lookups can be chained.
+class LazyNode
+{
+public:
+    LazyNode() : m_doc(nullptr), m_item(0) {}
+
+    //! Tell if the handle refers to a value.
+    explicit operator bool() const
+    { return m_doc != nullptr; }
+
+    //! Get the type of the value (included files are parsed to know it).
+    Node::Type type() const;
+
+    //! Get the number of entries of an object, or elements of an array
+    //!   (and 0 for other or included values).
+    std::size_t size() const;
+
+    bool exists(std::string_view key) const
+    { return static_cast<bool>(find(key)); }
+
+    //! Get the value of an object entry (or an empty handle).
+    LazyNode find(std::string_view key) const;
+
+    //! Same as above, throwing if the entry doesn't exist.
+    LazyNode get(std::string_view key) const
+    {
+        LazyNode value = find(key);
+        if (!value) throw std::out_of_range("json::LazyNode::get: no such key");
+        return value;
+    }
+
+    //! Get the element of an array, or the value of the i-th entry of an object.
+    LazyNode at(std::size_t i) const;
+
+    //! Get the key of the i-th entry of an object.
+    std::string_view key(std::size_t i) const;
+
+    //! Parse the value (if not already), and get its node, owned by the
+    //!   document.
+    Node* node() const;
+
+private:
+    friend class LazyDocument;
+
+    LazyNode(LazyDocument* doc, std::size_t item) : m_doc(doc), m_item(item) {}
+
+private:
+    LazyDocument* m_doc;
+    std::size_t m_item;
+};
+
+//! A document whose values are only parsed when accessed.
+//! A single pass over the tokens checks the syntax, and records where
+//!   each value begins (and the keys of objects), so that untouched
+//!   values only cost their index entry.
+//! Redefinitions of object entries are only detected when parsing a
+//!   value, and included files are parsed by node().
+//! Objects and arrays whose values were already parsed reuse their
+//!   nodes when they are parsed in turn, and the values of a parsed
+//!   object or array are its nodes' children.
+class LazyDocument
+{
+public:
+    LazyDocument() {}
+
+    LazyDocument(LazyDocument const&) = delete;
+    LazyDocument& operator=(LazyDocument const&) = delete;
+
+    //! Index a file, which is kept memory-mapped for as long as the
+    //!   document lives.
+    LazyNode parse(std::string const& file)
+    {
+        reset();
+
+        if (!m_file.open(file))
+            throw std::runtime_error("json::LazyDocument::parse: unable to open \"" + file + "\"");
+
+        return M_parse(m_file.data(), m_file.size());
+    }
+
+    //! Same as above, for a buffer (that is copied in the document).
+    LazyNode parse(const char* data, std::size_t size)
+    {
+        reset();
+
+        m_copy.assign(data, size);
+        return M_parse(m_copy.data(), m_copy.size());
+    }
+
+    //! Get the root value (or an empty handle if nothing is parsed).
+    LazyNode root()
+    { return m_items.empty() ? LazyNode() : LazyNode(this, m_items.size() - 1); }
+
+    void reset()
+    {
+        m_items.clear();
+        m_arena.release();
+        m_includes.clear();
+        m_file.close();
+        m_copy.clear();
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+private:
+    friend class LazyNode;
+
+    //! An indexed value.
+    //! The children of an object or array are contiguous (from first),
+    //!   and so are all its descendants (from begin, up to its last child).
+    struct Item
+    {
+        Token::Info at;
+        Node::Type type;
+        bool include;
+        std::size_t begin;
+        std::size_t first;
+        std::size_t count;
+        //! Object entries' key, and its hash
+        std::string_view key;
+        uint32_t hash;
+        Node* node;
+    };
+
+    LazyNode M_parse(const char* data, std::size_t size)
+    {
+        m_data = data;
+        m_size = size;
+
+        Lexer lex(data, size, true);
+        if (lex.seek().type() != Token::LeftBrace && lex.seek().type() != Token::LeftBracket)
+            throw TokenError(lex.seek(), "expected `[' at beginning of array definition");
+
+        // The root is indexed last
+        std::vector<Item> pending;
+        M_index(lex, pending);
+        m_items.push_back(pending.back());
+        return root();
+    }
+
+    //! Index the next value, appending it to pending (before its parent
+    //!   is complete), and its children to the items.
+    void M_index(Lexer& lex, std::vector<Item>& pending)
+    {
+        Item item;
+        item.at = lex.seek().info();
+        item.include = false;
+        item.begin = item.first = item.count = 0;
+        item.hash = 0;
+        item.node = nullptr;
+
+        Token::Type type = lex.seek().type();
+        if (type == Token::Bad)
+            throw TokenError(lex.seek(), "bad token");
+
+        if (type == Token::LeftBrace || type == Token::LeftBracket)
+        {
+            bool object = type == Token::LeftBrace;
+            Token::Type close = object ? Token::RightBrace : Token::RightBracket;
+            std::size_t mark = pending.size();
+            std::size_t begin = m_items.size();
+            lex.get();
+
+            while (lex.seek().type() != close)
+            {
+                std::string_view key;
+                if (object)
+                {
+                    if (lex.seek().type() != Token::String)
+                        throw TokenError(lex.seek(), "expected a identifier key");
+                    key = lex.seek().text().view();
+                    if (lex.seek().text().owned())
+                        key = m_arena.intern(key).view();
+                    lex.get();
+
+                    if (lex.seek().type() != Token::Colon)
+                        throw TokenError(lex.seek(), "expected `:' after identifier");
+                    lex.get();
+                }
+
+                M_index(lex, pending);
+                pending.back().key = key;
+                pending.back().hash = object ? ObjectNode::hash(key) : 0;
+
+                if (lex.seek().type() != Token::Comma)
+                    break;
+                lex.get();
+            }
+
+            if (lex.seek().type() != close)
+            {
+                throw TokenError(lex.seek(), object ? "expected `}' at end of object declaration" :
+                                                      "expected `]' at end of array declaration");
+            }
+            lex.get();
+
+            // Children are moved to the items once complete (after
+            //   their own descendants)
+            item.type = object ? Node::Object : Node::Array;
+            item.begin = begin;
+            item.first = m_items.size();
+            item.count = pending.size() - mark;
+            m_items.insert(m_items.end(), pending.begin() + mark, pending.end());
+            pending.resize(mark);
+        }
+        else if (type == Token::True || type == Token::False)
+        {
+            item.type = Node::Boolean;
+            lex.get();
+        }
+        else if (type == Token::Null)
+        {
+            item.type = Node::Null;
+            lex.get();
+        }
+        else if (type == Token::Number)
+        {
+            item.type = Node::Number;
+            lex.get();
+        }
+        else if (type == Token::String)
+        {
+            item.type = Node::String;
+            lex.get();
+        }
+        else if (type == Token::Include)
+        {
+            item.type = Node::Null;
+            item.include = true;
+            lex.get();
+        }
+        else
+            throw TokenError(lex.seek(), "unexpected token");
+
+        pending.push_back(item);
+    }
+
+    //! Parse an indexed value, from its first token.
+    //! Objects and arrays with already parsed descendants are built from
+    //!   their children instead, reusing those nodes.
+    Node* M_node(Item& item)
+    {
+        if (item.node)
+            return item.node;
+
+        if (M_parsed(item))
+            item.node = M_build(item);
+        else
+        {
+            Lexer lex(m_data + item.at.offset, m_size - item.at.offset, true, item.at);
+            Parser parser(lex, &m_arena, &m_includes);
+            item.node = parser.value();
+            M_adopt(item);
+        }
+
+        return item.node;
+    }
+
+    //! Record the nodes of a parsed value's descendants, so that they
+    //!   are the ones given for them later on.
+    void M_adopt(Item const& item)
+    {
+        for (std::size_t i = item.first; i < item.first + item.count; ++i)
+        {
+            Item& child = m_items[i];
+            if (item.type == Node::Object)
+                child.node = item.node->downcast<ObjectNode>()->find(child.key, child.hash);
+            else
+            {
+                // Through the const array, that stays packed if it is
+                ArrayNode const* array = item.node->downcast<ArrayNode>();
+                child.node = const_cast<Node*>(array->at(i - item.first));
+            }
+
+            if (!child.include && (child.type == Node::Object || child.type == Node::Array))
+                M_adopt(child);
+        }
+    }
+
+    //! Tell if any descendant of a value was parsed.
+    bool M_parsed(Item const& item) const
+    {
+        for (std::size_t i = item.begin; i < item.first + item.count; ++i)
+        {
+            if (m_items[i].node)
+                return true;
+        }
+
+        return false;
+    }
+
+    //! Build an object or array from its children's nodes.
+    Node* M_build(Item const& item)
+    {
+        Token token(item.type == Node::Object ? Token::LeftBrace : Token::LeftBracket);
+        token.setInfo(item.at);
+
+        if (item.type == Node::Object)
+        {
+            ObjectNode* object = m_arena.make<ObjectNode>(token, m_arena.resource());
+            Stats::node(object);
+            for (std::size_t i = item.first; i < item.first + item.count; ++i)
+            {
+                Item& entry = m_items[i];
+                if (!object->insert(Text::reference(entry.key), M_node(entry)))
+                {
+                    Token key(Token::String, Text::reference(entry.key));
+                    key.setInfo(entry.at);
+                    throw TokenError(key, "redifinition of object entry `" + key.text().str() + "'");
+                }
+            }
+            return object;
+        }
+
+        ArrayNode* array = m_arena.make<ArrayNode>(token, m_arena.resource());
+        Stats::node(array);
+        array->impl().reserve(item.count);
+        for (std::size_t i = item.first; i < item.first + item.count; ++i)
+            array->impl().push_back(M_node(m_items[i]));
+        return array;
+    }
+
+private:
+    MappedFile m_file;
+    std::string m_copy;
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+
+    std::vector<Item> m_items;
+    Arena m_arena;
+    IncludeResolver m_includes;
+};
+
+inline Node::Type LazyNode::type() const
+{
+    if (!m_doc)
+        return Node::Null;
+
+    LazyDocument::Item& item = m_doc->m_items[m_item];
+    return item.include ? m_doc->M_node(item)->type() : item.type;
+}
+
+inline std::size_t LazyNode::size() const
+{ return m_doc ? m_doc->m_items[m_item].count : 0; }
+
+inline LazyNode LazyNode::find(std::string_view key) const
+{
+    if (!m_doc)
+        return LazyNode();
+
+    LazyDocument::Item const& item = m_doc->m_items[m_item];
+    if (item.type != Node::Object)
+        return LazyNode();
+
+    uint32_t h = ObjectNode::hash(key);
+    for (std::size_t i = item.first; i < item.first + item.count; ++i)
+    {
+        LazyDocument::Item const& entry = m_doc->m_items[i];
+        if (entry.hash == h && entry.key == key)
+            return LazyNode(m_doc, i);
+    }
+
+    return LazyNode();
+}
+
+inline LazyNode LazyNode::at(std::size_t i) const
+{
+    if (!m_doc)
+        return LazyNode();
+
+    LazyDocument::Item const& item = m_doc->m_items[m_item];
+    if (i >= item.count) throw std::domain_error("json::LazyNode::at: index out of bounds");
+    return LazyNode(m_doc, item.first + i);
+}
+
+inline std::string_view LazyNode::key(std::size_t i) const
+{
+    LazyNode entry = at(i);
+    return entry ? m_doc->m_items[entry.m_item].key : std::string_view();
+}
+
+inline Node* LazyNode::node() const
+{ return m_doc ? m_doc->M_node(m_doc->m_items[m_item]) : nullptr; }
+
+inline Parser::~Parser()
+{}
+
+inline Node* Parser::M_include(std::string const& file)
+{
+    if (!m_includes)
+    {
+        m_ownIncludes = std::make_unique<IncludeResolver>();
+        m_includes = m_ownIncludes.get();
+    }
+
+    return m_includes->resolve(file)->clone(m_arena);
+}
+
+// --------------------------------------------------------------------------------------
+// Template
+// --------------------------------------------------------------------------------------
+
+//! Common abstract template element interface.
+class Element
+{
+    //! Needed to share the extraction helpers below.
+    friend class Template;
+    friend class Plan;
+    template <typename T, typename E> friend struct Codec;
+public:
+    enum Type
+    {
+        User,
+        Scalar,
+        POD,
+        Raw,
+        Blob,
+        Vector,
+        Map,
+        Object,
+        Array
+    };
+    
+public:
+    Element() : refs(1) {}
+    virtual ~Element() {}
+    virtual Type type() const = 0;
+    virtual void extract(Node* node) const = 0;
+    virtual Node* synthetize() const = 0;
+    virtual bool isConst() const = 0;
+
+    //! Extract a value directly from the lexer's tokens, without
+    //!   building its nodes.
+    //! By default the value is parsed, then extracted from the tree.
+    virtual void extract(Lexer& lex) const
+    {
+        std::unique_ptr<Node> node(Parser(lex).value());
+        extract(node.get());
+    }
+
+    //! Serialize the bound value directly to the writer, formatted
+    //!   as Node::serialize() does (at the given indentation level).
+    //! By default the value is synthetized, then serialized.
+    virtual void write(Writer& out, int level, bool indent) const
+    {
+        std::unique_ptr<Node> node(synthetize());
+        out.node(node.get(), level, indent);
+    }
+
+    //! Tell if the bound value is serialized on several lines.
+    virtual bool multiline() const
+    {
+        std::unique_ptr<Node> node(synthetize());
+        return Writer::multiline(node.get());
+    }
+
+    //! Same as extract(node), reporting errors through the status
+    //!   instead of throwing (returns false then).
+    //! By default the errors thrown by extract() are caught, so that
+    //!   user elements may keep reporting them by throwing.
+    virtual bool extract(Node* node, Status& status) const
+    {
+        try
+        {
+            extract(node);
+        }
+        catch (std::exception const& e)
+        {
+            status = Status::from(e);
+            return false;
+        }
+        return true;
+    }
+
+    //! Same as extract(lex), reporting errors through the status.
+    virtual bool extract(Lexer& lex, Status& status) const
+    {
+        try
+        {
+            extract(lex);
+        }
+        catch (std::exception const& e)
+        {
+            status = Status::from(e);
+            return false;
+        }
+        return true;
+    }
+
+protected:
+    //! Get an item of an array to extract from, without unpacking it for
+    //!   good (extracting never modifies the tree, see ArrayNode).
+    static Node* M_item(ArrayNode const* arr, std::size_t i)
+    { return const_cast<Node*>(arr->at(i)); }
+
+    //! Decode a chunk of text by slices, passing the decoded bytes to
+    //!   out(const uint8_t* data, std::size_t size), returns false at
+    //!   the first bad encoded character.
+    template <typename C, typename F>
+    static bool M_feed(Decoder<C>& decoder, std::string_view chunk, F const& out)
+    {
+        uint8_t slice[4096 * C::groupBytes];
+        while (!chunk.empty())
+        {
+            std::size_t n = std::min<std::size_t>(chunk.size(), 4096 * C::groupChars);
+            std::size_t size = decoder.decode(chunk.substr(0, n), slice);
+            if (!decoder.valid())
+                return false;
+
+            out(slice, size);
+            chunk.remove_prefix(n);
+        }
+        return true;
+    }
+
+    //! Report an error, either by throwing or through the status
+    //!   (returns false then).
+    static bool M_fail(Status* status, Status const& failure)
+    {
+        if (!status)
+            failure.raise();
+
+        *status = failure;
+        return false;
+    }
+
+    //! Extract with a child element, either throwing or reporting
+    //!   errors through the status (if any).
+    template <typename S>
+    static bool M_extractChild(Element const& elem, S&& source, Status* status)
+    {
+        if (status)
+            return elem.extract(source, *status);
+
+        elem.extract(source);
+        return true;
+    }
+
+    //! Check that a token begins a value.
+    static bool M_value(Token const& token, Status* status)
+    {
+        Token::Type tt = token.type();
+        if (tt == Token::Number || tt == Token::True || tt == Token::False || tt == Token::String ||
+            tt == Token::LeftBrace || tt == Token::LeftBracket || tt == Token::Null)
+            return true;
+
+        if (tt == Token::Bad)
+            return M_fail(status, Status(Status::Syntax, "bad token", token));
+        return M_fail(status, Status(Status::Syntax, "unexpected token", token));
+    }
+
+    //! Tell if a token begins a value of the given type.
+    static bool M_is(Token::Type tt, Node::Type type)
+    {
+        if (tt == Token::Number)
+            return type == Node::Number;
+        else if (tt == Token::True || tt == Token::False)
+            return type == Node::Boolean;
+        else if (tt == Token::String)
+            return type == Node::String;
+        else if (tt == Token::LeftBrace)
+            return type == Node::Object;
+        else if (tt == Token::LeftBracket)
+            return type == Node::Array;
+        return type == Node::Null;
+    }
+
+    //! Check that the next token begins a value, and tell
+    //!   if this value has the given type.
+    static bool M_expect(Lexer& lex, Node::Type type)
+    {
+        M_value(lex.seek(), nullptr);
+        return M_is(lex.seek().type(), type);
+    }
+
+    //! Same as above, reporting a value of another type as a
+    //!   mismatch (whose message is what).
+    static bool M_expect(Lexer& lex, Node::Type type, const char* what, Status* status)
+    {
+        if (!M_value(lex.seek(), status))
+            return false;
+        if (!M_is(lex.seek().type(), type))
+            return M_fail(status, Status(Status::Mismatch, what, lex.seek()));
+        return true;
+    }
+
+    //! If the next token is an include directive, extract
+    //!   from the included file instead.
+    bool M_include(Lexer& lex) const
+    { return M_include(lex, [this](Lexer& sub) { extract(sub); }); }
+
+    //! Same as above, extracting with the given function.
+    template <typename F>
+    static bool M_include(Lexer& lex, F const& extract)
+    {
+        if (lex.seek().type() != Token::Include)
+            return false;
+
+        Include include(lex.seek().text().str());
+        MappedFile const& map = include.map();
+
+        Lexer sub(map.data(), map.size());
+        M_document(sub);
+        extract(sub);
+
+        lex.get();
+        return true;
+    }
+
+    //! Check that a document begins with an object or an array.
+    static bool M_document(Lexer& lex, Status* status = nullptr)
+    {
+        if (lex.seek().type() != Token::LeftBrace && lex.seek().type() != Token::LeftBracket)
+            return M_fail(status, Status(Status::Syntax, "expected `[' at beginning of array definition", lex.seek()));
+        return true;
+    }
+
+    //! Parse an object key and its separator.
+    static bool M_key(Lexer& lex, Token& key, Status* status)
+    {
+        if (lex.seek().type() != Token::String)
+            return M_fail(status, Status(Status::Syntax, "expected a identifier key", lex.seek()));
+        key = lex.get();
+
+        if (lex.seek().type() != Token::Colon)
+            return M_fail(status, Status(Status::Syntax, "expected `:' after identifier", lex.seek()));
+        lex.get();
+
+        return true;
+    }
+
+    static Token M_key(Lexer& lex)
+    {
+        Token key;
+        M_key(lex, key, nullptr);
+        return key;
+    }
+
+    //! Skip a value that is not bound (see Parser::skip()).
+    static bool M_skip(Lexer& lex, Status* status)
+    {
+        if (status)
+            return Parser(lex).skip(*status);
+
+        Parser(lex).skip();
+        return true;
+    }
+
+    //! Eat a comma between two entries, telling if there is one.
+    static bool M_next(Lexer& lex)
+    {
+        if (lex.seek().type() != Token::Comma)
+            return false;
+        lex.get();
+        return true;
+    }
+
+    //! Eat the closing } or ] of a container.
+    static bool M_close(Lexer& lex, Token::Type type, Status* status = nullptr)
+    {
+        if (lex.seek().type() != type)
+        {
+            if (type == Token::RightBrace)
+                return M_fail(status, Status(Status::Syntax, "expected `}' at end of object declaration", lex.seek()));
+            return M_fail(status, Status(Status::Syntax, "expected `]' at end of array declaration", lex.seek()));
+        }
+        lex.get();
+        return true;
+    }
+
+    //! Write the opening character of a container.
+    static void M_open(Writer& out, char ch, int level, bool indent, bool multi)
+    {
+        if (indent) out.indent(level);
+        out.put(ch);
+        if (multi) out.put('\n');
+    }
+
+    //! Write the closing character of a container.
+    static void M_end(Writer& out, char ch, int level, bool multi)
+    {
+        if (multi) out.indent(level);
+        out.put(ch);
+    }
+
+    //! Write an object entry (see ObjectNode::M_serialize()).
+    static void M_writeEntry(Writer& out, std::string_view key, Element const& elem,
+                             int level, bool indent, bool last)
+    {
+        if (indent) out.indent(level + 4);
+        out.string(key);
+        out.write(": ");
+
+        if (indent && elem.multiline())
+        {
+            out.put('\n');
+            elem.write(out, level + 4, indent);
+        }
+        else
+        {
+            elem.write(out, 0, false);
+        }
+
+        if (!last) out.write(", ");
+        if (indent) out.put('\n');
+    }
+
+    //! Write an array element (see ArrayNode::M_serialize()).
+    static void M_writeItem(Writer& out, Element const& elem, int level, bool multi, bool last)
+    {
+        if (multi)
+            elem.write(out, level + 4, true);
+        else
+            elem.write(out, 0, false);
+
+        if (!last) out.write(", ");
+        if (multi) out.put('\n');
+    }
+    
+public:
+    //! Take another reference to this element.
+    void acquire() const
+    { refs.fetch_add(1, std::memory_order_relaxed); }
+
+    //! Release a reference to this element, deleting it with the last one.
+    void release() const
+    {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+public:
+    //! Elements are shared by templates, possibly from several threads.
+    mutable std::atomic<int> refs;
+};
+
+//! Terminal element interface (specialized below).
+template <typename T, typename = void>
+class Terminal : public Element
+{
+public:
+    Terminal(T&)
+    {}
+
+    Terminal(T const&)
+    {}
+    
+    Type type() const
+    { return Element::Scalar; }
+    
+    void extract(Node* node)
+    { throw NodeError(node, "json::Terminal::extract: direct extraction is not supported for this type"); }
+    
+    Node* synthetize() const
+    { return 0; }
+
+    bool isConst() const
+    { return false; }
+};
+
+//! Generic scalar element.
+template <Node::Type tp, typename N, typename T>
+class Scalar : public Element
+{
+public:
+    Scalar(T& ref) :
+        m_temp(nullptr),
+        m_ref(ref),
+        m_is_const(false)
+    {}
+
+    Scalar(T const& const_ref) :
+        m_temp(nullptr),
+        m_ref(const_cast<T&>(const_ref)),
+        m_is_const(true)
+    {}
+
+    Scalar(T&& temp) :
+        m_temp(std::make_unique<T>(temp)),
+        m_ref(*m_temp),
+        m_is_const(true)
+    {}
+    
+    Type type() const
+    { return Element::Scalar; }
+    
+    void extract(Node* node) const
+    { M_extract(node, nullptr); }
+
+    bool extract(Node* node, Status& status) const
+    { return M_extract(node, &status); }
+
+    void extract(Lexer& lex) const
+    { M_extract(lex, nullptr); }
+
+    bool extract(Lexer& lex, Status& status) const
+    { return M_extract(lex, &status); }
+    
+    Node* synthetize() const
+    { return new N(m_ref); }
+
+    void write(Writer& out, int level, bool indent) const
+    {
+        if (indent) out.indent(level);
+        M_write(out, m_ref);
+    }
+
+    bool multiline() const
+    { return false; }
+
+    bool isConst() const
+    { return false; }
+    
+protected:
+    //! Extract, either throwing or reporting errors through the status.
+    bool M_extract(Node* node, Status* status) const
+    {
+        if (m_is_const)
+            return M_fail(status, Status(Status::Other, "json::Scalar[const]::extract extracting to const binding", node));
+
+        if (node->type() != tp)
+            return M_fail(status, Status(Status::Mismatch, "json::Scalar::extract: expecting a node of type ", node).expected(tp));
+        M_assign(m_ref, node->downcast<N>());
+        return true;
+    }
+
+    bool M_extract(Lexer& lex, Status* status) const
+    {
+        bool ok = true;
+        if (M_include(lex, [&](Lexer& sub) { ok = M_extract(sub, status); }))
+            return ok;
+
+        if (m_is_const)
+            return M_fail(status, Status(Status::Other, "json::Scalar[const]::extract extracting to const binding", lex.seek()));
+
+        if (!M_value(lex.seek(), status))
+            return false;
+        if (!M_is(lex.seek().type(), tp))
+            return M_fail(status, Status(Status::Mismatch, "json::Scalar::extract: expecting a node of type ", lex.seek()).expected(tp));
+        M_assign(m_ref, lex.get());
+        return true;
+    }
+
+    //! Numbers are converted from their own representation.
+    static void M_assign(T& ref, NumberNode* node)
+    { ref = node->as<T>(); }
+
+    template <typename X>
+    static void M_assign(T& ref, X* node)
+    { ref = node->value(); }
+
+    //! Same as above, from a token of the expected type (strings
+    //!   being moved out of it).
+    static void M_assign(T& ref, Token&& token)
+    {
+        if constexpr (tp == Node::Number)
+            ref = NumberNode::convert<T>(token);
+        else if constexpr (tp == Node::Boolean)
+            ref = token.type() == Token::True;
+        else
+            ref = token.release();
+    }
+
+    static void M_write(Writer& out, T const& value)
+    {
+        if constexpr (tp == Node::Number)
+            out.number(value);
+        else if constexpr (tp == Node::Boolean)
+            out.boolean(value);
+        else
+            out.string(value);
+    }
+
+protected:
+    std::unique_ptr<T> m_temp;
+    T& m_ref;
+    bool m_is_const;
+};
+
+//! Generic POD element, encoded with C (see Hex and Base64).
+template <typename T, typename C = Hex>
+class POD : public Element
+{
+public:
+    POD(T& ref) :
+        m_ref(ref),
+        m_is_const(false)
+    {}
+
+    POD(T const& ref) :
+        m_ref(const_cast<T&>(ref)),
+        m_is_const(true)
+    {}
+
+    Type type() const
+    { return Element::POD; }
+
+    void extract(Node* node) const
+    { M_extract(node, nullptr); }
+
+    //! Decoding errors are still thrown (see Template::extract()).
+    bool extract(Node* node, Status& status) const
+    { return M_extract(node, &status); }
+
+    void extract(Lexer& lex) const
+    { M_extract(lex, nullptr); }
+
+    bool extract(Lexer& lex, Status& status) const
+    { return M_extract(lex, &status); }
+
+    Node* synthetize() const
+    {
+        std::string text(C::encodedSize(sizeof(T)), '\0');
+        C::encode(&m_ref, sizeof(T), &text[0]);
+        return new StringNode(std::move(text));
+    }
+
+    void write(Writer& out, int level, bool indent) const
+    {
+        if (indent) out.indent(level);
+        out.binary<C>(&m_ref, sizeof(T));
+    }
+
+    bool multiline() const
+    { return false; }
+
+    bool isConst() const
+    { return m_is_const; }
+
+private:
+    bool M_extract(Node* node, Status* status) const
+    {
+        if (m_is_const)
+            return M_fail(status, Status(Status::Other, "json::POD[const]::extract: extracting to const binding", node));
+
+        if (node->type() != Node::String)
+            return M_fail(status, Status(Status::Mismatch, "json::POD::extract: expecting a string node", node));
+
+        M_decode(node, node->downcast<json::StringNode>()->value());
+        return true;
+    }
+
+    bool M_extract(Lexer& lex, Status* status) const
+    {
+        if (!m_is_const && M_stream(lex))
+            return true;
+
+        bool ok = true;
+        if (M_include(lex, [&](Lexer& sub) { ok = M_extract(sub, status); }))
+            return ok;
+
+        if (m_is_const)
+            return M_fail(status, Status(Status::Other, "json::POD[const]::extract: extracting to const binding", lex.seek()));
+
+        if (!M_expect(lex, Node::String, "json::POD::extract: expecting a string node", status))
+            return false;
+
+        Token token = lex.get();
+        M_decode(token, token.value());
+        return true;
+    }
+
+    //! Decode the next string while it is lexed (see Lexer::stream()),
+    //!   returns false if the next token isn't such a string.
+    bool M_stream(Lexer& lex) const
+    {
+        Token token;
+        Decoder<C> decoder;
+        uint8_t bytes[sizeof(T)];
+        std::size_t size = 0;
+        bool valid = true;
+
+        bool streamed = lex.stream(token, [&](std::string_view chunk)
+        {
+            valid = valid && M_feed(decoder, chunk, [&](const uint8_t* data, std::size_t n)
+            {
+                if (size < sizeof(T))
+                    std::memcpy(bytes + size, data, std::min(n, sizeof(T) - size));
+                size += n;
+            });
+        });
+
+        if (!streamed)
+            return false;
+
+        if (token.type() == Token::Bad)
+            throw TokenError(token, "bad token");
+        if (!valid)
+            throw NodeError(token, "json::POD::extract: bad encoded character");
+        if (!decoder.complete() || size != sizeof(T))
+            M_badSize(token, size);
+
+        std::memcpy(&m_ref, bytes, sizeof(T));
+        return true;
+    }
+
+    template <typename W>
+    static void M_badSize(W const& where, std::size_t size)
+    {
+        std::ostringstream ss;
+        ss << "json::POD::extract: bad buffer size (expecting " << sizeof(T) << ", got ";
+        ss << size << ")";
+        throw NodeError(where, ss.str());
+    }
+
+    //! Decode the text straight to the bound value, errors being
+    //!   located at where (a node or a token).
+    template <typename W>
+    void M_decode(W const& where, std::string_view text) const
+    {
+        std::size_t size;
+        if (!C::decodedSize(text, size) || size != sizeof(T))
+            M_badSize(where, size);
+
+        // Don't leave the value half decoded on errors
+        uint8_t bytes[sizeof(T)];
+        if (!C::decode(text, bytes))
+            throw NodeError(where, "json::POD::extract: bad encoded character");
+        std::memcpy(&m_ref, bytes, sizeof(T));
+    }
+
+private:
+    T& m_ref;
+    bool m_is_const;
+};
+
+//! Used to tag types as POD
+template <typename T, typename C = Hex>
+struct tag_as_pod_impl
+{
+public:
+    tag_as_pod_impl(T& ref) : ref(ref)
+    {}
+
+    T& ref;
+};
+
+//! Used to tag types as POD (const)
+template <typename T, typename C = Hex>
+struct tag_as_const_pod_impl
+{
+public:
+    tag_as_const_pod_impl(T const& ref) : ref(ref)
+    {}
+
+    T const& ref;
+};
+
+//! Used to tag types as POD
+template<typename T>
+static tag_as_pod_impl<T> ref_as_pod(T& ref)
+{ return tag_as_pod_impl<T>(ref); }
+
+template<typename T>
+static tag_as_const_pod_impl<T> ref_as_pod(T const& ref)
+{ return tag_as_const_pod_impl<T>(ref); }
+
+//! Used to tag types as POD, encoded in base64
+template<typename T>
+static tag_as_pod_impl<T, Base64> ref_as_base64(T& ref)
+{ return tag_as_pod_impl<T, Base64>(ref); }
+
+template<typename T>
+static tag_as_const_pod_impl<T, Base64> ref_as_base64(T const& ref)
+{ return tag_as_const_pod_impl<T, Base64>(ref); }
+
+
+//! Generic raw element, encoded with C (see Hex and Base64).
+template <typename T, typename C = Hex>
+class Raw : public Element
+{
+public:
+    Raw(T*& ptr, std::size_t& size) :
+        m_ptr(&ptr),
+        m_size(&size),
+        m_is_const(false)
+    {}
+
+    Raw(T const* ptr, std::size_t size) :
+        m_ptr(new T*(const_cast<T*>(ptr))),
+        m_size(new std::size_t(size)),
+        m_is_const(true)
+    {}
+
+    ~Raw()
+    {
+        if (m_is_const)
+        {
+            delete m_ptr;
+            delete m_size;
+        }
+    }
+
+    Type type() const
+    { return Element::Raw; }
+
+    void extract(Node* node) const
+    { M_extract(node, nullptr); }
+
+    //! Decoding errors are still thrown (see Template::extract()).
+    bool extract(Node* node, Status& status) const
+    { return M_extract(node, &status); }
+
+    void extract(Lexer& lex) const
+    { M_extract(lex, nullptr); }
+
+    bool extract(Lexer& lex, Status& status) const
+    { return M_extract(lex, &status); }
+
+    Node* synthetize() const
+    {
+        if (!*m_size || !*m_ptr)
+            return new NullNode();
+
+        std::string text(C::encodedSize(*m_size * sizeof(T)), '\0');
+        C::encode(*m_ptr, *m_size * sizeof(T), &text[0]);
+        return new StringNode(std::move(text));
+    }
+
+    void write(Writer& out, int level, bool indent) const
+    {
+        if (indent) out.indent(level);
+
+        if (!*m_size || !*m_ptr)
+            out.write("null");
+        else
+            out.binary<C>(*m_ptr, *m_size * sizeof(T));
+    }
+
+    bool multiline() const
+    { return false; }
+
+    bool isConst() const
+    { return m_is_const; }
+
+private:
+    bool M_extract(Node* node, Status* status) const
+    {
+        if (m_is_const)
+            return M_fail(status, Status(Status::Other, "json::Raw[const]::extract: extracting to const binding", node));
+
+        if (*m_ptr != 0)
+            return M_fail(status, Status(Status::Other, "json::Raw::extract: target memory is already allocated", node));
+
+        if (node->type() == Node::Null)
+        {
+            *m_size = 0UL;
+            *m_ptr = nullptr;
+            return true;
+        }
+
+        if (node->type() != Node::String)
+            return M_fail(status, Status(Status::Mismatch, "json::Raw::extract: expecting a string node", node));
+
+        M_decode(node, node->downcast<json::StringNode>()->value());
+        return true;
+    }
+
+    bool M_extract(Lexer& lex, Status* status) const
+    {
+        if (!m_is_const && !*m_ptr && M_stream(lex))
+            return true;
+
+        bool ok = true;
+        if (M_include(lex, [&](Lexer& sub) { ok = M_extract(sub, status); }))
+            return ok;
+
+        if (m_is_const)
+            return M_fail(status, Status(Status::Other, "json::Raw[const]::extract: extracting to const binding", lex.seek()));
+
+        if (*m_ptr != 0)
+            return M_fail(status, Status(Status::Other, "json::Raw::extract: target memory is already allocated", lex.seek()));
+
+        if (!M_value(lex.seek(), status))
+            return false;
+
+        if (M_is(lex.seek().type(), Node::Null))
+        {
+            lex.get();
+            *m_size = 0UL;
+            *m_ptr = nullptr;
+            return true;
+        }
+
+        if (!M_expect(lex, Node::String, "json::Raw::extract: expecting a string node", status))
+            return false;
+
+        Token token = lex.get();
+        M_decode(token, token.value());
+        return true;
+    }
+
+    //! Decode the next string while it is lexed (see Lexer::stream()),
+    //!   returns false if the next token isn't such a string.
+    bool M_stream(Lexer& lex) const
+    {
+        Token token;
+        Decoder<C> decoder;
+
+        // Strings of contiguous buffers are passed in a single chunk
+        //   (unless they have escape sequences), that is decoded straight
+        //   to the buffer; the next ones are only joined at the end
+        std::unique_ptr<T[]> first;
+        std::size_t size = 0;
+        std::vector<std::pair<std::unique_ptr<T[]>, std::size_t>> parts;
+
+        bool streamed = lex.stream(token, [&](std::string_view chunk)
+        {
+            std::unique_ptr<T[]> bytes(M_allocate(Decoder<C>::capacity(chunk.size())));
+            std::size_t n = decoder.decode(chunk, bytes.get());
+            if (!decoder.valid())
+                throw NodeError(token, "json::Raw::extract: bad encoded character");
+
+            if (!first)
+                first = std::move(bytes);
+            else
+                parts.emplace_back(std::move(bytes), n);
+            size += n;
+        });
+
+        if (!streamed)
+            return false;
+
+        if (token.type() == Token::Bad)
+            throw TokenError(token, "bad token");
+        if (!decoder.complete() || size % sizeof(T) != 0)
+            throw NodeError(token, "json::Raw::extract: bad buffer size");
+
+        if (!first)
+            first.reset(M_allocate(0));
+        else if (!parts.empty())
+        {
+            std::unique_ptr<T[]> joined(M_allocate(size));
+            uint8_t* at = reinterpret_cast<uint8_t*>(joined.get());
+
+            std::size_t n = size;
+            for (auto const& part : parts)
+                n -= part.second;
+            std::memcpy(at, first.get(), n);
+            at += n;
+
+            for (auto const& part : parts)
+            {
+                std::memcpy(at, part.first.get(), part.second);
+                at += part.second;
+            }
+            first = std::move(joined);
+        }
+
+        *m_size = size / sizeof(T);
+        *m_ptr = first.release();
+        return true;
+    }
+
+    //! Allocate a buffer holding at least size bytes.
+    static T* M_allocate(std::size_t size)
+    { return new T[(size + sizeof(T) - 1) / sizeof(T)]; }
+
+    //! Decode the text straight to the allocated buffer, errors
+    //!   being located at where (a node or a token).
+    template <typename W>
+    void M_decode(W const& where, std::string_view text) const
+    {
+        std::size_t size;
+        if (!C::decodedSize(text, size) || size % sizeof(T) != 0)
+            throw NodeError(where, "json::Raw::extract: bad buffer size");
+
+        std::unique_ptr<T[]> buffer(new T[size / sizeof(T)]);
+        if (!C::decode(text, buffer.get()))
+            throw NodeError(where, "json::Raw::extract: bad encoded character");
+
+        *m_size = size / sizeof(T);
+        *m_ptr = buffer.release();
+    }
+
+private:
+    T** m_ptr;
+    std::size_t* m_size;
+    bool m_is_const;
+};
+
+//! Used to tag types as RAW
+template <typename T, typename C = Hex>
+struct tag_as_raw_impl
+{
+public:
+    tag_as_raw_impl(T*& ptr, std::size_t& size) : ptr(ptr), size(size)
+    {}
+
+    T*& ptr;
+    std::size_t& size;
+};
+
+//! Used to tag types as RAW (const)
+template <typename T, typename C = Hex>
+struct tag_as_const_raw_impl
+{
+public:
+    tag_as_const_raw_impl(T const* ptr, std::size_t size) : ptr(ptr), size(size)
+    {}
+
+    T const* ptr;
+    std::size_t size;
+};
+
+//! Used to tag types as RAW
+template<typename T>
+static tag_as_raw_impl<T> ref_as_raw(T*& ptr, std::size_t& size)
+{ return tag_as_raw_impl<T>(ptr, size); }
+
+template<typename T>
+static tag_as_const_raw_impl<T> ref_as_raw(T const* ptr, std::size_t size)
+{ return tag_as_const_raw_impl<T>(ptr, size); }
+
+//! Used to tag types as RAW, encoded in base64
+template<typename T>
+static tag_as_raw_impl<T, Base64> ref_as_base64(T*& ptr, std::size_t& size)
+{ return tag_as_raw_impl<T, Base64>(ptr, size); }
+
+template<typename T>
+static tag_as_const_raw_impl<T, Base64> ref_as_base64(T const* ptr, std::size_t size)
+{ return tag_as_const_raw_impl<T, Base64>(ptr, size); }
+
+//! Binary data streamed through callbacks, encoded with C (see Hex and
+//!   Base64).
+//! It is decoded by chunks while lexing, that are passed to the sink
+//!   as they come (rather than holding the whole text in a token, then
+//!   decoding it to an allocated buffer), and it is encoded by chunks
+//!   read from the source when written.
+template <typename C = Hex>
+class Blob : public Element
+{
+public:
+    //! Receive the decoded bytes by chunks, returns false to reject them.
+    typedef std::function<bool(const void* data, std::size_t size)> Sink;
+
+    //! Write up to size bytes to data, returns the number of bytes
+    //!   written (0 at the end of the data).
+    typedef std::function<std::size_t(void* data, std::size_t size)> Source;
+
+    //! Bind a sink (to extract to) and/or a source (to write from), the
+    //!   number of decoded bytes being set to size (if any).
+    Blob(Sink sink, Source source, std::size_t* size = nullptr) :
+        m_sink(std::move(sink)),
+        m_source(std::move(source)),
+        m_size(size)
+    {}
+
+    Type type() const
+    { return Element::Blob; }
+
+    void extract(Node* node) const
+    { M_extract(node, nullptr); }
+
+    //! Decoding errors (and the ones of the sink) are still thrown (see
+    //!   Template::extract()).
+    bool extract(Node* node, Status& status) const
+    { return M_extract(node, &status); }
+
+    void extract(Lexer& lex) const
+    { M_extract(lex, nullptr); }
+
+    bool extract(Lexer& lex, Status& status) const
+    { return M_extract(lex, &status); }
+
+    Node* synthetize() const
+    {
+        if (!m_source)
+            return new NullNode();
+
+        std::string text;
+        M_read([&](const uint8_t* data, std::size_t size)
+        {
+            std::size_t at = text.size();
+            text.resize(at + C::encodedSize(size));
+            C::encode(data, size, &text[at]);
+        });
+        return new StringNode(std::move(text));
+    }
+
+    void write(Writer& out, int level, bool indent) const
+    {
+        if (indent) out.indent(level);
+
+        if (!m_source)
+        {
+            out.write("null");
+            return;
+        }
+
+        out.put('"');
+        M_read([&](const uint8_t* data, std::size_t size) { out.encoded<C>(data, size); });
+        out.put('"');
+    }
+
+    bool multiline() const
+    { return false; }
+
+    bool isConst() const
+    { return !m_sink; }
+
+private:
+    bool M_extract(Node* node, Status* status) const
+    {
+        if (!m_sink)
+            return M_fail(status, Status(Status::Other, "json::Blob[source]::extract: extracting to a source binding", node));
+
+        if (node->type() != Node::String && node->type() != Node::Null)
+            return M_fail(status, Status(Status::Mismatch, "json::Blob::extract: expecting a string node", node));
+
+        if (m_size)
+            *m_size = 0;
+
+        if (node->type() == Node::String)
+        {
+            Decoder<C> decoder;
+            M_decode(node, decoder, node->downcast<json::StringNode>()->value());
+            M_finish(node, decoder);
+        }
+        return true;
+    }
+
+    bool M_extract(Lexer& lex, Status* status) const
+    {
+        Token token;
+        Decoder<C> decoder;
+
+        // Decode the next string while it is lexed (see Lexer::stream())
+        if (m_sink)
+        {
+            if (m_size)
+                *m_size = 0;
+
+            if (lex.stream(token, [&](std::string_view chunk) { M_decode(token, decoder, chunk); }))
+            {
+                if (token.type() == Token::Bad)
+                    return M_fail(status, Status(Status::Syntax, "bad token", token));
+                M_finish(token, decoder);
+                return true;
+            }
+        }
+
+        bool ok = true;
+        if (M_include(lex, [&](Lexer& sub) { ok = M_extract(sub, status); }))
+            return ok;
+
+        if (!m_sink)
+            return M_fail(status, Status(Status::Other, "json::Blob[source]::extract: extracting to a source binding", lex.seek()));
+
+        if (!M_value(lex.seek(), status))
+            return false;
+
+        if (M_is(lex.seek().type(), Node::Null))
+        {
+            lex.get();
+            return true;
+        }
+
+        if (!M_expect(lex, Node::String, "json::Blob::extract: expecting a string node", status))
+            return false;
+
+        // The string was already lexed
+        token = lex.get();
+        M_decode(token, decoder, token.value());
+        M_finish(token, decoder);
+        return true;
+    }
+
+    //! Decode a chunk of text to the sink, errors being located at
+    //!   where (a node or a token).
+    template <typename W>
+    void M_decode(W const& where, Decoder<C>& decoder, std::string_view chunk) const
+    {
+        bool valid = M_feed(decoder, chunk, [&](const uint8_t* data, std::size_t size)
+        {
+            if (size && !m_sink(data, size))
+                throw NodeError(where, "json::Blob::extract: the sink rejected the data");
+            if (m_size)
+                *m_size += size;
+        });
+
+        if (!valid)
+            throw NodeError(where, "json::Blob::extract: bad encoded character");
+    }
+
+    template <typename W>
+    static void M_finish(W const& where, Decoder<C> const& decoder)
+    {
+        if (!decoder.complete())
+            throw NodeError(where, "json::Blob::extract: bad buffer size");
+    }
+
+    //! Read the source by chunks, that are passed to
+    //!   out(const uint8_t* data, std::size_t size) by whole
+    //!   groups (apart from the last one).
+    template <typename F>
+    void M_read(F const& out) const
+    {
+        uint8_t chunk[4096 * C::groupBytes];
+        std::size_t size = 0;
+
+        for (;;)
+        {
+            std::size_t n = m_source(chunk + size, sizeof(chunk) - size);
+            size += n;
+            if ((n == 0 || size == sizeof(chunk)) && size)
+            {
+                out(chunk, size);
+                size = 0;
+            }
+
+            if (n == 0)
+                return;
+        }
+    }
+
+private:
+    Sink m_sink;
+    Source m_source;
+    std::size_t* m_size;
+};
+
+//! Used to tag sinks and sources as blobs
+template <typename C = Hex>
+struct tag_as_blob_impl
+{
+public:
+    tag_as_blob_impl(typename Blob<C>::Sink sink, typename Blob<C>::Source source, std::size_t* size = nullptr) :
+        sink(std::move(sink)), source(std::move(source)), size(size)
+    {}
+
+    typename Blob<C>::Sink sink;
+    typename Blob<C>::Source source;
+    std::size_t* size;
+};
+
+//! Used to tag a sink as blob (the codec being given explicitly for
+//!   others than Hex, e.g. ref_as_sink<Base64>(...)), the number of
+//!   decoded bytes being set to size (if any).
+template<typename C = Hex>
+static tag_as_blob_impl<C> ref_as_sink(typename Blob<C>::Sink sink, std::size_t* size = nullptr)
+{ return tag_as_blob_impl<C>(std::move(sink), nullptr, size); }
+
+//! Decode to an output stream.
+template<typename C = Hex>
+static tag_as_blob_impl<C> ref_as_sink(std::ostream& out, std::size_t* size = nullptr)
+{
+    return tag_as_blob_impl<C>([&out](const void* data, std::size_t n)
+    {
+        out.write(static_cast<const char*>(data), n);
+        return out.good();
+    }, nullptr, size);
+}
+
+//! Decode to a buffer of the given capacity (the data being rejected
+//!   if it doesn't fit), the number of decoded bytes being set to size.
+template<typename C = Hex>
+static tag_as_blob_impl<C> ref_as_sink(void* buffer, std::size_t capacity, std::size_t& size)
+{
+    std::size_t* at = &size;
+    return tag_as_blob_impl<C>([buffer, capacity, at](const void* data, std::size_t n)
+    {
+        // The decoded size is only updated once the chunk is accepted
+        if (n > capacity - *at)
+            return false;
+        std::memcpy(static_cast<uint8_t*>(buffer) + *at, data, n);
+        return true;
+    }, nullptr, at);
+}
+
+//! Used to tag a source as blob.
+template<typename C = Hex>
+static tag_as_blob_impl<C> ref_as_source(typename Blob<C>::Source source)
+{ return tag_as_blob_impl<C>(nullptr, std::move(source)); }
+
+//! Encode the rest of an input stream.
+template<typename C = Hex>
+static tag_as_blob_impl<C> ref_as_source(std::istream& in)
+{
+    return tag_as_blob_impl<C>(nullptr, [&in](void* data, std::size_t n)
+    {
+        in.read(static_cast<char*>(data), n);
+        return static_cast<std::size_t>(in.gcount());
+    });
+}
+
+//! Generic vector element.
+template <typename T>
+class Vector : public Element
+{
+public:
+    Vector(std::vector<T>& ref) :
+        m_temp(nullptr),
+        m_ref(ref),
+        m_is_const(false)
+    {}
+
+    Vector(std::vector<T> const& const_ref) :
+        m_temp(nullptr),
+        m_ref(const_cast<std::vector<T>&>(const_ref)),
+        m_is_const(true)
+    {}
+
+    Vector(std::vector<T>&& temp) :
+        m_temp(std::make_unique<std::vector<T>>(std::move(temp))),
+        m_ref(*m_temp),
+        m_is_const(true)
+    {}
+    
+    Type type() const
+    { return Element::Vector; }
+    
+    void extract(Node* node) const
+    { M_extract(node, nullptr); }
+
+    bool extract(Node* node, Status& status) const
+    { return M_extract(node, &status); }
+
+    void extract(Lexer& lex) const
+    { M_extract(lex, nullptr); }
+
+    bool extract(Lexer& lex, Status& status) const
+    { return M_extract(lex, &status); }
+    
+    Node* synthetize() const
+    {
+        ArrayNode* arr = new ArrayNode();
+        if constexpr (M_numbers)
+        {
+            if (JSON_PACKED_ARRAY_THRESHOLD && m_ref.size() >= JSON_PACKED_ARRAY_THRESHOLD &&
+                arr->M_pack(m_ref.data(), m_ref.size()))
+                return arr;
+        }
+
+        for (unsigned int i = 0; i < m_ref.size(); ++i)
+        {
+            Terminal<T> term(m_ref[i]);
+            arr->impl().push_back(term.synthetize());
+        }
+        return arr;
+    }
+
+    //! Vectors of numbers are written in a single loop.
+    void write(Writer& out, int level, bool indent) const
+    {
+        if constexpr (std::is_arithmetic<T>::value)
+        {
+            M_open(out, '[', level, indent, false);
+            for (std::size_t i = 0; i < m_ref.size(); ++i)
+            {
+                if (i) out.write(", ");
+                out.number(m_ref[i]);
+            }
+            M_end(out, ']', level, false);
+        }
+        else
+        {
+            bool multi = indent && multiline();
+            M_open(out, '[', level, indent, multi);
+            for (std::size_t i = 0; i < m_ref.size(); ++i)
+            {
+                Terminal<T> term(m_ref[i]);
+                M_writeItem(out, term, level, multi, i == m_ref.size() - 1);
+            }
+            M_end(out, ']', level, multi);
+        }
+    }
+
+    bool multiline() const
+    {
+        if constexpr (!std::is_arithmetic<T>::value)
+        {
+            for (std::size_t i = 0; i < m_ref.size(); ++i)
+            {
+                Terminal<T> term(m_ref[i]);
+                if (static_cast<Element const&>(term).multiline())
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    bool isConst() const
+    { return m_is_const; }
+
+private:
+    //! Vectors of numbers may be packed (see ArrayNode).
+    static constexpr bool M_numbers = std::is_arithmetic<T>::value && !std::is_same<T, bool>::value;
+
+    //! Extract, either throwing or reporting errors through the status.
+    bool M_extract(Node* node, Status* status) const
+    {
+        if (m_is_const)
+            return M_fail(status, Status(Status::Other, "json::Vector[const]::extract: extracting to const binding", node));
+
+        if (node->type() != Node::Array)
+            return M_fail(status, Status(Status::Mismatch, "json::Vector::extract: expecting an array node", node));
+        
+        ArrayNode const* arr = node->downcast<ArrayNode>();
+
+        // Packed numbers are converted all at once
+        if constexpr (M_numbers)
+        {
+            if (arr->packed())
+            {
+                m_ref.resize(arr->size());
+                arr->numbers(m_ref.data());
+                return true;
+            }
+        }
+        
+        m_ref.clear();
+        m_ref.reserve(arr->size());
+        for (unsigned int i = 0; i < arr->size(); ++i)
+        {
+            if (!M_extractItem([&](Terminal<T>& term) { return M_extractChild(term, M_item(arr, i), status); }))
+                return false;
+        }
+        return true;
+    }
+
+    bool M_extract(Lexer& lex, Status* status) const
+    {
+        bool ok = true;
+        if (M_include(lex, [&](Lexer& sub) { ok = M_extract(sub, status); }))
+            return ok;
+
+        if (m_is_const)
+            return M_fail(status, Status(Status::Other, "json::Vector[const]::extract: extracting to const binding", lex.seek()));
+
+        if (!M_expect(lex, Node::Array, "json::Vector::extract: expecting an array node", status))
+            return false;
+        lex.get();
+
+        m_ref.clear();
+        while (lex.seek().type() != Token::RightBracket)
+        {
+            if (!M_extractItem([&](Terminal<T>& term) { return M_extractChild(term, lex, status); }))
+                return false;
+
+            if (!M_next(lex))
+                break;
+        }
+        return M_close(lex, Token::RightBracket, status);
+    }
+
+    //! Extract a new item in place, at the end of the vector (which
+    //!   is left as is on errors).
+    template <typename F>
+    bool M_extractItem(F const& extract) const
+    {
+        // Items of std::vector<bool> can't be referred to
+        if constexpr (std::is_same<T, bool>::value)
+        {
+            bool value = false;
+            Terminal<T> term(value);
+            if (!extract(term))
+                return false;
+            m_ref.push_back(value);
+            return true;
+        }
+        else
+        {
+            Terminal<T> term(m_ref.emplace_back());
+            bool ok;
+            try
+            {
+                ok = extract(term);
+            }
+            catch (...)
+            {
+                m_ref.pop_back();
+                throw;
+            }
+
+            if (!ok)
+                m_ref.pop_back();
+            return ok;
+        }
+    }
+    
+private:
+    std::unique_ptr<std::vector<T>> m_temp;
+    std::vector<T>& m_ref;
+    bool m_is_const;
+};
+
+//! Generic map element.
+template <typename T>
+class Map : public Element
+{
+public:
+    Map(std::map<std::string, T>& ref) :
+        m_temp(nullptr),
+        m_ref(ref),
+        m_is_const(false)
+    {}
+
+    Map(std::map<std::string, T> const& ref) :
+        m_temp(nullptr),
+        m_ref(const_cast<std::map<std::string, T>&>(ref)),
+        m_is_const(true)
+    {}
+
+    Map(std::map<std::string, T>&& temp) :
+        m_temp(std::make_unique<std::map<std::string, T>>(std::move(temp))),
+        m_ref(*m_temp),
+        m_is_const(true)
+    {}
+    
+    Type type() const
+    { return Element::Map; }
+    
+    void extract(Node* node) const
+    { M_extract(node, nullptr); }
+
+    bool extract(Node* node, Status& status) const
+    { return M_extract(node, &status); }
+
+    void extract(Lexer& lex) const
+    { M_extract(lex, nullptr); }
+
+    bool extract(Lexer& lex, Status& status) const
+    { return M_extract(lex, &status); }
+    
+    Node* synthetize() const
+    {
+        ObjectNode* obj = new ObjectNode();
+        for (typename std::map<std::string, T>::iterator it = m_ref.begin();
+            it != m_ref.end(); ++it)
+        {
+            Terminal<T> term(it->second);
+            obj->insert(it->first, term.synthetize());
+        }
+        return obj;
+    }
+
+    void write(Writer& out, int level, bool indent) const
+    {
+        M_open(out, '{', level, indent, indent);
+        for (auto it = m_ref.begin(); it != m_ref.end(); ++it)
+        {
+            Terminal<T> term(it->second);
+            M_writeEntry(out, it->first, term, level, indent, std::next(it) == m_ref.end());
+        }
+        M_end(out, '}', level, indent);
+    }
+
+    bool multiline() const
+    { return true; }
+
+    bool isConst() const
+    { return m_is_const; }
+
+private:
+    //! Extract, either throwing or reporting errors through the status.
+    bool M_extract(Node* node, Status* status) const
+    {
+        if (m_is_const)
+            return M_fail(status, Status(Status::Other, "json::Map[const]::extract: extracting to const binding", node));
+
+        if (node->type() != Node::Object)
+            return M_fail(status, Status(Status::Mismatch, "json::Map::extract: expecting an object node", node));
+        
+        ObjectNode* obj = node->downcast<ObjectNode>();
+        
+        m_ref.clear();
+        for (auto it = obj->impl().begin(); it != obj->impl().end(); ++it)
+        {
+            auto res = m_ref.try_emplace(it->first.str());
+            if (!M_extractEntry(res.first, [&](Terminal<T>& term) { return M_extractChild(term, it->second, status); }))
+                return false;
+        }
+        return true;
+    }
+
+    bool M_extract(Lexer& lex, Status* status) const
+    {
+        bool ok = true;
+        if (M_include(lex, [&](Lexer& sub) { ok = M_extract(sub, status); }))
+            return ok;
+
+        if (m_is_const)
+            return M_fail(status, Status(Status::Other, "json::Map[const]::extract: extracting to const binding", lex.seek()));
+
+        if (!M_expect(lex, Node::Object, "json::Map::extract: expecting an object node", status))
+            return false;
+        lex.get();
+
+        m_ref.clear();
+        while (lex.seek().type() != Token::RightBrace)
+        {
+            Token key;
+            if (!M_key(lex, key, status))
+                return false;
+
+            auto res = m_ref.try_emplace(key.release());
+            if (!res.second)
+                return M_fail(status, Status(Status::Syntax, "redifinition of object entry `", key).key(res.first->first));
+
+            if (!M_extractEntry(res.first, [&](Terminal<T>& term) { return M_extractChild(term, lex, status); }))
+                return false;
+
+            if (!M_next(lex))
+                break;
+        }
+        return M_close(lex, Token::RightBrace, status);
+    }
+
+    //! Extract a new entry in place (which is removed on errors).
+    template <typename F>
+    bool M_extractEntry(typename std::map<std::string, T>::iterator it, F const& extract) const
+    {
+        Terminal<T> term(it->second);
+        bool ok;
+        try
+        {
+            ok = extract(term);
+        }
+        catch (...)
+        {
+            m_ref.erase(it);
+            throw;
+        }
+
+        if (!ok)
+            m_ref.erase(it);
+        return ok;
+    }
+    
+private:
+    std::unique_ptr<std::map<std::string, T>> m_temp;
+    std::map<std::string, T>& m_ref;
+    bool m_is_const;
+};
+
+//! Below are the specializations for the Terminal
+//!   element class.
+//! Instances that are not specialized here will systematically trigger errors
+//!   (see beginning of this file).
+
+template <>
+class Terminal<int32_t> : public Scalar<Node::Number, NumberNode, int32_t>
+{
+public:
+    using Scalar::Scalar;
+};
+
+template <>
+class Terminal<uint32_t> : public Scalar<Node::Number, NumberNode, uint32_t>
+{
+public:
+    using Scalar::Scalar;
+};
+
+template <>
+class Terminal<int64_t> : public Scalar<Node::Number, NumberNode, int64_t>
+{
+public:
+    using Scalar::Scalar;
+};
+
+template <>
+class Terminal<uint64_t> : public Scalar<Node::Number, NumberNode, uint64_t>
+{
+public:
+    using Scalar::Scalar;
+};
+
+template <>
+class Terminal<float> : public Scalar<Node::Number, NumberNode, float>
+{
+public:
+    using Scalar::Scalar;
+};
+
+template <>
+class Terminal<double> : public Scalar<Node::Number, NumberNode, double>
+{
+public:
+    using Scalar::Scalar;
+};
+
+template <>
+class Terminal<bool> : public Scalar<Node::Boolean, BooleanNode, bool>
+{
+public:
+    using Scalar::Scalar;
+};
+
+template <>
+class Terminal<std::string> : public Scalar<Node::String, StringNode, std::string>
+{
+public:
+    using Scalar::Scalar;
+};
+
+template <>
+class Terminal<const char*> : public Scalar<Node::String, StringNode, std::string>
+{
+public:
+    Terminal(const char* ptr) :
+        Scalar(static_cast<std::string const&>(m_str)),
+        m_str(ptr)
+    {}
+
+private:
+    std::string m_str;
+};
+
+template <typename T>
+class Terminal<std::vector<T> > : public Vector<T>
+{
+public:
+    using Vector<T>::Vector;
+};
+
+template <typename T>
+class Terminal<std::map<std::string, T> > : public Map<T>
+{
+public:
+    using Map<T>::Map;
+};
+
+template <typename T, typename C>
+class Terminal<tag_as_pod_impl<T, C> > : public POD<T, C>
+{
+public:
+    Terminal(tag_as_pod_impl<T, C> ref) : POD<T, C>(ref.ref)
+    {}
+};
+
+template <typename T, typename C>
+class Terminal<tag_as_const_pod_impl<T, C> > : public POD<T, C>
+{
+public:
+    Terminal(tag_as_const_pod_impl<T, C> ref) : POD<T, C>(ref.ref)
+    {}
+};
+
+template <typename T, typename C>
+class Terminal<tag_as_raw_impl<T, C> > : public Raw<T, C>
+{
+public:
+    Terminal(tag_as_raw_impl<T, C> ref) : Raw<T, C>(ref.ptr, ref.size)
+    {}
+};
+
+template <typename T, typename C>
+class Terminal<tag_as_const_raw_impl<T, C> > : public Raw<T, C>
+{
+public:
+    Terminal(tag_as_const_raw_impl<T, C> ref) : Raw<T, C>(ref.ptr, ref.size)
+    {}
+};
+
+template <typename C>
+class Terminal<tag_as_blob_impl<C> > : public Blob<C>
+{
+public:
+    Terminal(tag_as_blob_impl<C> ref) : Blob<C>(std::move(ref.sink), std::move(ref.source), ref.size)
+    {}
+};
+
+//! An object element class.
+class Object : public Element
+{
+    friend class Template;
+    friend class Plan;
+public:
+    Object() {}
+    ~Object()
+    {
+        for (Elements::const_iterator it = m_elements.begin();
+             it != m_elements.end(); ++it)
+        {
+            it->second->release();
         }
-        else if (next.type() == Token::LeftBrace)
-            return M_object();
-        else if (next.type() == Token::LeftBracket)
-            return M_array();
-        else if (next.type() == Token::Include)
+    }
+    
+    void bind(std::string const& name, Element* elem)
+    {
+        if (m_elements.find(name) != m_elements.end())
+            throw std::runtime_error("json::Object::bind: element `" + name + "' is already bound");
+        
+        elem->acquire();
+        m_elements[name] = elem;
+    }
+
+    Type type() const { return Element::Object; }
+
+    void extract(Node* node) const
+    { M_extract(node, nullptr); }
+
+    bool extract(Node* node, Status& status) const
+    { return M_extract(node, &status); }
+
+    //! Entries that are not bound are skipped (without opening
+    //!   their includes).
+    void extract(Lexer& lex) const
+    { M_extract(lex, false, nullptr); }
+
+    bool extract(Lexer& lex, Status& status) const
+    { return M_extract(lex, false, &status); }
+
+    Node* synthetize() const
+    {
+        ObjectNode* obj = new ObjectNode();
+        for (Elements::const_iterator it = m_elements.begin();
+             it != m_elements.end(); ++it)
         {
-            Node* tree = JSON_NAMESPACE(parse)(next.value());
-            m_lex.get();
-            return tree;
+            obj->insert(it->first, it->second->synthetize());
         }
+        return obj;
+    }
 
-        return 0;
+    void write(Writer& out, int level, bool indent) const
+    {
+        M_open(out, '{', level, indent, indent);
+        for (Elements::const_iterator it = m_elements.begin(); it != m_elements.end(); ++it)
+            M_writeEntry(out, it->first, *it->second, level, indent, std::next(it) == m_elements.end());
+        M_end(out, '}', level, indent);
     }
 
-    Node* M_object()
+    bool multiline() const
+    { return true; }
+
+    bool isConst() const { return false; }
+    
+private:
+    //! Extract, either throwing or reporting errors through the status.
+    bool M_extract(Node* node, Status* status) const
     {
-        // Eat the opening {
-        if (m_lex.seek().type() != Token::LeftBrace)
-            throw TokenError(m_lex.seek(), "expected `{' at beginning of object declaration");
+        if (node->type() != Node::Object)
+            return M_fail(status, Status(Status::Mismatch, "json::Object::extract: type mismatch", node));
+        ObjectNode* obj = node->downcast<ObjectNode>();
         
-        // Create appropriate node
-        ObjectNode* node = new ObjectNode(m_lex.get());
+        for (Elements::const_iterator it = m_elements.begin();
+             it != m_elements.end(); ++it)
+        {
+            Node* value = obj->find(it->first);
+            if (!value)
+                return M_fail(status, Status(Status::Missing, "json::Object::extract: missing element `", node).key(it->first));
+            
+            if (!M_extractChild(*it->second, value, status))
+                return false;
+        }
+        return true;
+    }
 
-        // Parse object entries
-        for (;;)
+    //! Extract the object, stopping as soon as all the bound entries
+    //!   are extracted if partial (the rest of the object is left unread).
+    bool M_extract(Lexer& lex, bool partial, Status* status) const
+    {
+        bool ok = true;
+        if (M_include(lex, [&](Lexer& sub) { ok = M_extract(sub, partial, status); }))
+            return ok;
+
+        if (!M_expect(lex, Node::Object, "json::Object::extract: type mismatch", status))
+            return false;
+        Token open = lex.get();
+
+        if (partial && m_elements.empty())
+            return true;
+
+        // All the keys are kept, as the parser rejects redefined unbound ones too
+        ObjectKeys keys;
+        std::vector<Elements::const_iterator> seen;
+        seen.reserve(m_elements.size());
+        while (lex.seek().type() != Token::RightBrace)
         {
-            // Allow empty objects
-            if (m_lex.seek().type() == Token::RightBrace)
-                break;
+            Token key;
+            if (!M_key(lex, key, status))
+                return false;
+            if (!keys.insert(key.text()))
+                return M_fail(status, Status(Status::Syntax, "redifinition of object entry `", key).key());
+
+            Elements::const_iterator it = m_elements.find(key.value());
+            if (it == m_elements.end())
+            {
+                if (!M_skip(lex, status))
+                    return false;
+            }
+            else
+            {
+                seen.push_back(it);
 
-            // Get key identifier
-            if (m_lex.seek().type() != Token::String)
-                throw TokenError(m_lex.seek(), "expected a identifier key");
-            Token token = m_lex.get();
-            std::string key = token.value();
+                if (!M_extractChild(*it->second, lex, status))
+                    return false;
+                if (partial && seen.size() == m_elements.size())
+                    return true;
+            }
 
-            if (node->exists(key))
-                throw TokenError(token, "redifinition of object entry `" + key + "'");
+            if (!M_next(lex))
+                break;
+        }
+        if (!M_close(lex, Token::RightBrace, status))
+            return false;
 
-            // Get the separator
-            if (m_lex.seek().type() != Token::Colon)
-                throw TokenError(m_lex.seek(), "expected `:' after identifier");
-            m_lex.get();
+        if (seen.size() == m_elements.size())
+            return true;
 
-            // Parse the object element value
-            node->impl()[key] = M_atom();
+        for (Elements::const_iterator it = m_elements.begin(); it != m_elements.end(); ++it)
+        {
+            if (std::find(seen.begin(), seen.end(), it) == seen.end())
+                return M_fail(status, Status(Status::Missing, "json::Object::extract: missing element `", open).key(it->first));
+        }
+        return true;
+    }
 
-            // Eat comma, if needed
-            if (m_lex.seek().type() == Token::Comma)
-                m_lex.get();
-            else
-                break;
+    typedef std::map<std::string, Element*, std::less<>> Elements;
+    Elements m_elements;
+};
+
+//! An array element class.
+class Array : public Element
+{
+    friend class Plan;
+public:
+    Array() {}
+    ~Array()
+    {
+        for (unsigned int i = 0; i < m_elements.size(); ++i)
+        {
+            m_elements[i]->release();
         }
+    }
+    
+    void bind(Element* elem)
+    {
+        elem->acquire();
+        m_elements.push_back(elem);
+    }
 
-        // Eat the closing }
-        if (m_lex.seek().type() != Token::RightBrace)
-            throw TokenError(m_lex.seek(), "expected `}' at end of object declaration");
-        m_lex.get();
+    Type type() const { return Element::Array; }
 
-        return node;
+    void extract(Node* node) const
+    { M_extract(node, nullptr); }
+
+    bool extract(Node* node, Status& status) const
+    { return M_extract(node, &status); }
+
+    //! Extra elements are skipped (without opening their includes).
+    void extract(Lexer& lex) const
+    { M_extract(lex, nullptr); }
+
+    bool extract(Lexer& lex, Status& status) const
+    { return M_extract(lex, &status); }
+
+    Node* synthetize() const
+    {
+        ArrayNode* arr = new ArrayNode();
+        for (unsigned int i = 0; i < m_elements.size(); ++i)
+        {
+            arr->impl().push_back(m_elements[i]->synthetize());
+        }
+        return arr;
     }
 
-    Node* M_array()
+    void write(Writer& out, int level, bool indent) const
     {
-        // Eat the opening [
-        if (m_lex.seek().type() != Token::LeftBracket)
-            throw TokenError(m_lex.seek(), "expected `[' at beginning of array definition");
+        bool multi = indent && multiline();
+        M_open(out, '[', level, indent, multi);
+        for (std::size_t i = 0; i < m_elements.size(); ++i)
+            M_writeItem(out, *m_elements[i], level, multi, i == m_elements.size() - 1);
+        M_end(out, ']', level, multi);
+    }
 
-        // Create appropriate node
-        ArrayNode* node = new ArrayNode(m_lex.get());
+    bool multiline() const
+    {
+        for (std::size_t i = 0; i < m_elements.size(); ++i)
+            if (m_elements[i]->multiline())
+                return true;
+        return false;
+    }
 
-        // Parse array entries
-        for (;;)
+    bool isConst() const { return false; }
+    
+private:
+    //! Extract, either throwing or reporting errors through the status.
+    bool M_extract(Node* node, Status* status) const
+    {
+        if (node->type() != Node::Array)
+            return M_fail(status, Status(Status::Mismatch, "json::Array::extract: type mismatch", node));
+        ArrayNode const* arr = node->downcast<ArrayNode>();
+        
+        for (unsigned int i = 0; i < m_elements.size(); ++i)
         {
-            // Allow empty arrays
-            if (m_lex.seek().type() == Token::RightBracket)
-                break;
+            if (i >= arr->size())
+                return M_fail(status, Status(Status::Size, "json::Array::extract: size mismatch in array", node));
+            
+            if (!M_extractChild(*m_elements[i], M_item(arr, i), status))
+                return false;
+        }
+        return true;
+    }
+
+    bool M_extract(Lexer& lex, Status* status) const
+    {
+        bool ok = true;
+        if (M_include(lex, [&](Lexer& sub) { ok = M_extract(sub, status); }))
+            return ok;
 
-            // Get array element
-            node->impl().push_back(M_atom());
+        if (!M_expect(lex, Node::Array, "json::Array::extract: type mismatch", status))
+            return false;
+        Token open = lex.get();
 
-            // Get comma, if needed
-            if (m_lex.seek().type() == Token::Comma)
-                m_lex.get();
+        std::size_t i = 0;
+        for (; lex.seek().type() != Token::RightBracket; ++i)
+        {
+            if (i < m_elements.size())
+                ok = M_extractChild(*m_elements[i], lex, status);
             else
-                break;
-        };
+                ok = M_skip(lex, status);
+            if (!ok)
+                return false;
 
-        if (m_lex.seek().type() != Token::RightBracket)
-            throw TokenError(m_lex.seek(), "expected `]' at end of array declaration");
-        m_lex.get();
+            if (!M_next(lex))
+            {
+                ++i;
+                break;
+            }
+        }
+        if (!M_close(lex, Token::RightBracket, status))
+            return false;
 
-        return node;
+        if (i < m_elements.size())
+            return M_fail(status, Status(Status::Size, "json::Array::extract: size mismatch in array", open));
+        return true;
     }
-    
-private:
-    Lexer& m_lex;
-};
 
-// --------------------------------------------------------------------------------------
-// Template
-// --------------------------------------------------------------------------------------
+    std::vector<Element*> m_elements;
+};
 
-//! Common abstract template element interface.
-class Element
+//! A small helper Element overloaded class
+//!   (that just defines type() const).
+class UserElement : public Element
 {
 public:
-    enum Type
-    {
-        User,
-        Scalar,
-        POD,
-        Raw,
-        Vector,
-        Map,
-        Object,
-        Array
-    };
-    
-public:
-    Element() : refs(1) {}
-    virtual ~Element() {}
-    virtual Type type() const = 0;
-    virtual void extract(Node* node) const = 0;
-    virtual Node* synthetize() const = 0;
-    virtual bool isConst() const = 0;
-    
-public:
-    int refs;
+    Type type() const
+    { return Element::User; }
 };
 
-//! Terminal element interface (specialized below).
-template <typename T>
-class Terminal : public Element
+//! The final JSON template class.
+class Template
 {
+    friend class Plan;
+    friend class Selector;
 public:
-    Terminal(T&)
-    {}
-
-    Terminal(T const&)
-    {}
-    
-    Type type() const
-    { return Element::Scalar; }
+    Template() : m_impl(nullptr) {}
+    Template(Template& cpy) : m_impl(nullptr) { operator=(cpy); }
+    Template(Template const& cpy) : m_impl(nullptr) { operator=(cpy); }
+    Template(Template&& mov) noexcept : m_impl(mov.m_impl) { mov.m_impl = nullptr; }
     
-    void extract(Node* node)
-    { throw NodeError(node, "json::Terminal::extract: direct extraction is not supported for this type"); }
+    ~Template()
+    { reset(); }
     
-    Node* synthetize() const
-    { return 0; }
-
-    bool isConst() const
-    { return false; }
-};
+    //! Templates share their elements, so that once bound they can be
+    //!   copied and used from several threads (extractions still write
+    //!   to the bound values, that must not be shared).
+    Template& operator=(Template const& cpy)
+    {
+        Element* impl = cpy.m_impl;
+        if (impl)
+            impl->acquire();
+        reset();
+        m_impl = impl;
+        return *this;
+    }
 
-//! Generic scalar element.
-template <Node::Type tp, typename N, typename T>
-class Scalar : public Element
-{
-public:
-    Scalar(T& ref) :
-        m_temp(nullptr),
-        m_ref(ref),
-        m_is_const(false)
-    {}
+    Template& operator=(Template&& mov) noexcept
+    {
+        if (this != &mov)
+        {
+            reset();
+            m_impl = mov.m_impl;
+            mov.m_impl = nullptr;
+        }
+        return *this;
+    }
+    
+    template <typename T>
+    Template(T& ref) :
+        m_impl(nullptr)
+    { bind(ref); }
 
-    Scalar(T const& const_ref) :
-        m_temp(nullptr),
-        m_ref(const_cast<T&>(const_ref)),
-        m_is_const(true)
-    {}
+    template <typename T>
+    Template(T const& const_ref) :
+        m_impl(nullptr)
+    { bind(const_ref); }
 
-    Scalar(T&& temp) :
-        m_temp(std::make_unique<T>(temp)),
-        m_ref(*m_temp),
-        m_is_const(true)
-    {}
+    template <typename T>
+    Template(T&& temp) :
+        m_impl(nullptr)
+    { bind(std::forward<T>(temp)); }
     
-    Type type() const
-    { return Element::Scalar; }
+    template <typename T>
+    Template& bind(T& ref)
+    {
+        if (m_impl) throw std::runtime_error("json::Template::bind: template is already bound");
+        m_impl = new Terminal<T>(ref);
+        return *this;
+    }
     
-    void extract(Node* node) const
+    template <typename T>
+    Template& bind(T const& const_ref)
     {
-        if (m_is_const)
-            throw NodeError(node, "json::Scalar[const]::extract extracting to const binding");
-
-        if (node->type() != tp)
-            throw NodeError(node, "json::Scalar::extract: expecting a node of type " + Node::typeName(tp));
-        m_ref = node->downcast<N>()->value();
+        if (m_impl) throw std::runtime_error("json::Template::bind: template is already bound");
+        m_impl = new Terminal<T>(const_ref);
+        return *this;
     }
     
-    Node* synthetize() const
-    { return new N(m_ref); }
-
-    bool isConst() const
-    { return false; }
+    template <typename T>
+    Template& bind(T&& temp)
+    {
+        if (m_impl) throw std::runtime_error("json::Template::bind: template is already bound");
+        m_impl = new Terminal<T>(std::forward<T>(temp));
+        return *this;
+    }
     
-protected:
-    std::unique_ptr<T> m_temp;
-    T& m_ref;
-    bool m_is_const;
-};
+    Template& bind(std::string const& name, Template const& tpl)
+    {
+        if (m_impl && m_impl->type() != Element::Object)
+            throw std::runtime_error("json::Template::bind: template is already bound");
+        
+        if (!m_impl)
+            m_impl = new Object();
+        
+        ((Object*) m_impl)->bind(name, tpl.m_impl);
+        return *this;
+    }
 
-//! Generic POD element.
-template <typename T>
-class POD : public Element
-{
-public:
-    POD(T& ref) :
-        m_ref(ref),
-        m_is_const(false)
-    {}
+    Template& bind_array(Template const& tpl)
+    {
+        if (m_impl && m_impl->type() != Element::Array)
+            throw std::runtime_error("json::Template::bind_array: template is already bound");
+        
+        if (!m_impl)
+            m_impl = new Array();
+        
+        ((Array*) m_impl)->bind(tpl.m_impl);
+        return *this;
+    }
 
-    POD(T const& ref) :
-        m_ref(const_cast<T&>(ref)),
-        m_is_const(true)
-    {}
+    bool bound() const { return m_impl; }
+    operator bool() const { return bound(); }
+    
+    //! Extract from a tree, which is left unchanged (so that threads may
+    //!   concurrently extract from a shared one).
+    void extract(Node const* node) const
+    {
+        if (!m_impl)
+            throw NodeError(const_cast<Node*>(node), "json::Template::extract: template is not bound !");
+        
+        Stats::Scope scope(Stats::Extracting);
+        m_impl->extract(const_cast<Node*>(node));
+    }
 
-    Type type() const
-    { return Element::POD; }
+    //! Same as above, reporting errors through the status instead of
+    //!   throwing (returns false on failures).
+    //! Extraction stops at the first error, so that the bound values
+    //!   may be partially overwritten.
+    bool extract(Node const* node, Status& status) const
+    {
+        Stats::Scope scope(Stats::Extracting);
+        return M_try(status, [&]()
+        {
+            if (!m_impl)
+                return Element::M_fail(&status, Status(Status::Other, "json::Template::extract: template is not bound !", node));
+            return m_impl->extract(const_cast<Node*>(node), status);
+        });
+    }
 
-    void extract(Node* node) const
+    //! Extract a whole document directly from the lexer's
+    //!   tokens (without building its tree).
+    void extract(Lexer& lex) const
     {
-        if (m_is_const)
-            throw NodeError(node, "json::POD[const]::extract: extracting to const binding");
+        if (!m_impl)
+            throw NodeError(lex.seek(), "json::Template::extract: template is not bound !");
 
-        if (node->type() != Node::String)
-            throw NodeError(node, "json::POD::extract: expecting a string node");
+        Stats::Scope scope(Stats::Extracting);
+        Element::M_document(lex);
+        m_impl->extract(lex);
+    }
 
-        std::string as_hex = node->downcast<json::StringNode>()->value();
-        if (as_hex.size() % 2 != 0 || as_hex.size() / 2 != sizeof(T))
+    //! Same as above, reporting errors through the status.
+    bool extract(Lexer& lex, Status& status) const
+    {
+        Stats::Scope scope(Stats::Extracting);
+        return M_try(status, [&]()
         {
-            std::ostringstream ss;
-            ss << "json::POD::extract: bad buffer size (expecting " << sizeof(T) << ", got ";
-            ss << as_hex.size() / 2 << ")";
-            throw NodeError(node, ss.str());
-        }
+            if (!m_impl)
+                return Element::M_fail(&status, Status(Status::Other, "json::Template::extract: template is not bound !", lex.seek()));
+            return Element::M_document(lex, &status) && m_impl->extract(lex, status);
+        });
+    }
 
-        uint8_t* data = reinterpret_cast<uint8_t*>(&m_ref);
-        for (std::size_t byte = 0; byte < as_hex.size()/2; ++byte)
-        {
-            std::istringstream ss(as_hex.substr(2*byte, 2));
-            ss >> std::hex;
-            int value;
-            ss >> value;
-            data[byte] = static_cast<uint8_t>(value & 0xFF);
-        }
+    //! Same as above, but stop reading the document as soon as all the
+    //!   entries bound to its root object are extracted: the rest of the
+    //!   document is neither read nor checked (and the lexer is left after
+    //!   the last extracted entry).
+    //! Documents whose root is not an object are extracted as a whole.
+    void extractPartial(Lexer& lex) const
+    {
+        if (!m_impl)
+            throw NodeError(lex.seek(), "json::Template::extract: template is not bound !");
+
+        Stats::Scope scope(Stats::Extracting);
+        Element::M_document(lex);
+        if (m_impl->type() == Element::Object)
+            static_cast<Object const*>(m_impl)->M_extract(lex, true, nullptr);
+        else
+            m_impl->extract(lex);
     }
 
     Node* synthetize() const
     {
-        std::ostringstream ss;
-        uint8_t* data = reinterpret_cast<uint8_t*>(&m_ref);
+        if (!m_impl)
+            throw std::runtime_error("json::Template::synthetize: template is not bound !");
+        
+        return m_impl->synthetize();
+    }
 
-        for (std::size_t byte = 0; byte < sizeof(T); ++byte)
-            ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(data[byte]);
+    //! Serialize the bound values directly to the writer (without
+    //!   synthetizing their tree).
+    void write(Writer& out, bool indent = true) const
+    {
+        if (!m_impl)
+            throw std::runtime_error("json::Template::write: template is not bound !");
 
-        return new StringNode(ss.str());
+        m_impl->write(out, 0, indent);
     }
 
-    bool isConst() const
-    { return m_is_const; }
+    void reset()
+    {
+        if (m_impl)
+            m_impl->release();
+        m_impl = nullptr;
+    }
 
+    //! Compile the template into an extraction plan (defined below).
+    Plan compile() const;
+    
 private:
-    T& m_ref;
-    bool m_is_const;
-};
-
-//! Used to tag types as POD
-template <typename T>
-struct tag_as_pod_impl
-{
-public:
-    tag_as_pod_impl(T& ref) : ref(ref)
-    {}
+    //! Extract with the given function, reporting errors through the
+    //!   status: the ones of the elements are reported without throwing,
+    //!   only the ones of included files, of decoding and of memory
+    //!   allocations being caught here.
+    template <typename F>
+    static bool M_try(Status& status, F const& extract)
+    {
+        status = Status();
+        try
+        {
+            return extract();
+        }
+        catch (std::exception const& e)
+        {
+            status = Status::from(e);
+        }
+        return false;
+    }
 
-    T& ref;
+    Element* m_impl;
 };
 
-//! Used to tag types as POD (const)
-template <typename T>
-struct tag_as_const_pod_impl
+//! A compiled template, to repeatedly extract documents of the
+//!   same structure.
+//! The objects and arrays of the template are flattened into a
+//!   contiguous array of steps, and object keys are hashed once
+//!   for all into small open-addressing tables.
+//! Plans are immutable once compiled, and keep their template alive
+//!   (which must not be bound any further).
+class Plan
 {
 public:
-    tag_as_const_pod_impl(T const& ref) : ref(ref)
-    {}
+    Plan(Template const& tpl) :
+        m_template(tpl)
+    {
+        if (!tpl.m_impl)
+            throw std::runtime_error("json::Template::compile: template is not bound !");
 
-    T const& ref;
-};
+        M_add(tpl.m_impl, std::string_view());
+        M_compile(0);
+    }
 
-//! Used to tag types as POD
-template<typename T>
-static tag_as_pod_impl<T> ref_as_pod(T& ref)
-{ return tag_as_pod_impl<T>(ref); }
+    //! Extract from a tree, which is left unchanged (as Template does).
+    void extract(Node const* node) const
+    {
+        Stats::Scope scope(Stats::Extracting);
+        M_extract(const_cast<Node*>(node), 0, nullptr);
+    }
 
-template<typename T>
-static tag_as_const_pod_impl<T> ref_as_pod(T const& ref)
-{ return tag_as_const_pod_impl<T>(ref); }
+    //! Same as above, reporting mismatches through the status instead
+    //!   of throwing (returns false on failures).
+    //! Extraction stops at the first mismatch, so that the bound values
+    //!   may be partially overwritten.
+    bool extract(Node const* node, Status& status) const
+    {
+        Stats::Scope scope(Stats::Extracting);
+        return Template::M_try(status, [&]() { return M_extract(const_cast<Node*>(node), 0, &status); });
+    }
 
+    //! Extract a whole document directly from the lexer's tokens.
+    void extract(Lexer& lex) const
+    {
+        Stats::Scope scope(Stats::Extracting);
+        Element::M_document(lex);
 
-//! Generic raw element.
-template <typename T>
-class Raw : public Element
-{
-public:
-    Raw(T*& ptr, std::size_t& size) :
-        m_ptr(&ptr),
-        m_size(&size),
-        m_is_const(false)
-    {}
+        std::vector<char> seen(m_steps.size(), 0);
+        M_extract(lex, 0, seen, false, nullptr);
+    }
 
-    Raw(T const* ptr, std::size_t size) :
-        m_ptr(new T*(const_cast<T*>(ptr))),
-        m_size(new std::size_t(size)),
-        m_is_const(true)
-    {}
+    //! Same as above, stopping as soon as all the entries bound to the
+    //!   root object are extracted (see Template::extractPartial()).
+    void extractPartial(Lexer& lex) const
+    {
+        Stats::Scope scope(Stats::Extracting);
+        Element::M_document(lex);
 
-    ~Raw()
+        std::vector<char> seen(m_steps.size(), 0);
+        M_extract(lex, 0, seen, true, nullptr);
+    }
+
+    //! Same as extract(lex), reporting errors through the status (see
+    //!   Template::extract()).
+    bool extract(Lexer& lex, Status& status) const
     {
-        if (m_is_const)
+        Stats::Scope scope(Stats::Extracting);
+        return Template::M_try(status, [&]()
         {
-            delete m_ptr;
-            delete m_size;
-        }
+            std::vector<char> seen(m_steps.size(), 0);
+            return Element::M_document(lex, &status) && M_extract(lex, 0, seen, false, &status);
+        });
     }
 
-    Type type() const
-    { return Element::Raw; }
+private:
+    struct Step
+    {
+        Element::Type type;
+        Element const* element;
+        //! Key of an object entry, and its hash
+        std::string_view key;
+        uint32_t hash;
+        //! Children steps (of objects and arrays)
+        uint32_t first;
+        uint32_t count;
+        //! Key table of objects, in m_table
+        uint32_t table;
+        uint32_t mask;
+    };
 
-    void extract(Node* node) const
+    static const uint32_t npos = ~0u;
+
+    uint32_t M_add(Element const* elem, std::string_view key)
     {
-        if (m_is_const)
-            throw NodeError(node, "json::Raw[const]::extract: extracting to const binding");
+        Step step = {};
+        step.type = elem->type();
+        step.element = elem;
+        step.key = key;
+        step.hash = ObjectNode::hash(key);
+
+        m_steps.push_back(step);
+        return static_cast<uint32_t>(m_steps.size() - 1);
+    }
 
-        if (*m_ptr != 0)
-            throw NodeError(node, "json::Raw::extract: target memory is already allocated");
+    //! Compile the children of a step, which are stored contiguously.
+    void M_compile(uint32_t index)
+    {
+        Element const* elem = m_steps[index].element;
+        uint32_t first = static_cast<uint32_t>(m_steps.size());
 
-        if (node->type() == Node::Null)
+        if (m_steps[index].type == Element::Object)
         {
-            *m_size = 0UL;
-            *m_ptr = nullptr;
+            Object const* obj = static_cast<Object const*>(elem);
+            for (auto it = obj->m_elements.begin(); it != obj->m_elements.end(); ++it)
+                M_add(it->second, it->first);
+        }
+        else if (m_steps[index].type == Element::Array)
+        {
+            Array const* arr = static_cast<Array const*>(elem);
+            for (std::size_t i = 0; i < arr->m_elements.size(); ++i)
+                M_add(arr->m_elements[i], std::string_view());
+        }
+        else
             return;
+
+        uint32_t count = static_cast<uint32_t>(m_steps.size()) - first;
+        m_steps[index].first = first;
+        m_steps[index].count = count;
+
+        // Keep the key tables at most half full
+        if (m_steps[index].type == Element::Object)
+        {
+            uint32_t size = 2;
+            while (size < 2 * count)
+                size *= 2;
+
+            uint32_t table = static_cast<uint32_t>(m_table.size());
+            m_table.resize(table + size, 0);
+            m_steps[index].table = table;
+            m_steps[index].mask = size - 1;
+
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                uint32_t slot = m_steps[first + i].hash & (size - 1);
+                while (m_table[table + slot])
+                    slot = (slot + 1) & (size - 1);
+                m_table[table + slot] = i + 1;
+            }
         }
 
-        if (node->type() != Node::String)
-            throw NodeError(node, "json::Raw::extract: expecting a string node");
+        for (uint32_t i = 0; i < count; ++i)
+            M_compile(first + i);
+    }
+
+    //! Find the child step of an object for the given key.
+    uint32_t M_find(Step const& step, std::string_view key) const
+    {
+        uint32_t h = ObjectNode::hash(key);
+        for (uint32_t slot = h & step.mask; m_table[step.table + slot]; slot = (slot + 1) & step.mask)
+        {
+            uint32_t i = step.first + m_table[step.table + slot] - 1;
+            if (m_steps[i].hash == h && m_steps[i].key == key)
+                return i;
+        }
+
+        return npos;
+    }
 
-        std::string as_hex = node->downcast<json::StringNode>()->value();
-        if (as_hex.size() % 2 != 0)
-            throw NodeError(node, "json::Raw::extract: bad buffer size");
+    static bool M_fail(Status* status, Status const& failure)
+    { return Element::M_fail(status, failure); }
 
-        *m_size = as_hex.size() / (2 * sizeof(T));
-        *m_ptr = new T[*m_size];
+    bool M_extract(Node* node, uint32_t index, Status* status) const
+    {
+        Step const& step = m_steps[index];
 
-        for (std::size_t i = 0; i < *m_size; ++i)
+        if (step.type == Element::Object)
         {
-            uint8_t* data = reinterpret_cast<uint8_t*>(&(*m_ptr)[i]);
+            if (node->type() != Node::Object)
+                return M_fail(status, Status(Status::Mismatch, "json::Object::extract: type mismatch", node));
+            ObjectNode* obj = node->downcast<ObjectNode>();
 
-            for (std::size_t byte = 0; byte < sizeof(T); ++byte)
+            for (uint32_t i = step.first; i < step.first + step.count; ++i)
             {
-                std::string nibbles = as_hex.substr(2*i * sizeof(T) + 2*byte, 2);
+                Node* value = obj->find(m_steps[i].key, m_steps[i].hash);
+                if (!value)
+                    return M_fail(status, Status(Status::Missing, "json::Object::extract: missing element `", node).key(m_steps[i].key));
+
+                if (!M_extract(value, i, status))
+                    return false;
+            }
+        }
+        else if (step.type == Element::Array)
+        {
+            if (node->type() != Node::Array)
+                return M_fail(status, Status(Status::Mismatch, "json::Array::extract: type mismatch", node));
+            ArrayNode const* arr = node->downcast<ArrayNode>();
 
-                std::istringstream ss(nibbles);
-                ss >> std::hex;
-                int value;
-                ss >> value;
+            for (uint32_t i = 0; i < step.count; ++i)
+            {
+                if (i >= arr->size())
+                    return M_fail(status, Status(Status::Size, "json::Array::extract: size mismatch in array", node));
 
-                data[byte] = static_cast<uint8_t>(value & 0xFF);
+                if (!M_extract(Element::M_item(arr, i), step.first + i, status))
+                    return false;
             }
         }
+        else
+            return Element::M_extractChild(*step.element, node, status);
+
+        return true;
     }
 
-    Node* synthetize() const
+    //! Entries that are not bound are skipped, as in Object::extract()
+    //!   (objects being left as soon as they are extracted if partial).
+    bool M_extract(Lexer& lex, uint32_t index, std::vector<char>& seen, bool partial, Status* status) const
     {
-        if (!*m_size || !*m_ptr)
-            return new NullNode();
+        Step const& step = m_steps[index];
 
-        std::ostringstream ss;
+        if (step.type != Element::Object && step.type != Element::Array)
+            return Element::M_extractChild(*step.element, lex, status);
 
-        for (std::size_t i = 0; i < *m_size; ++i)
+        bool ok = true;
+        if (Element::M_include(lex, [&](Lexer& sub) { ok = M_extract(sub, index, seen, partial, status); }))
+            return ok;
+
+        if (step.type == Element::Object)
         {
-            uint8_t* data = reinterpret_cast<uint8_t*>(&(*m_ptr)[i]);
-            for (std::size_t byte = 0; byte < sizeof(T); ++byte)
-                ss << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(data[byte]);
+            if (!Element::M_expect(lex, Node::Object, "json::Object::extract: type mismatch", status))
+                return false;
+            Token open = lex.get();
+
+            if (partial && step.count == 0)
+                return true;
+
+            ObjectKeys keys;
+            uint32_t found = 0;
+            while (lex.seek().type() != Token::RightBrace)
+            {
+                Token key;
+                if (!Element::M_key(lex, key, status))
+                    return false;
+                if (!keys.insert(key.text()))
+                    return M_fail(status, Status(Status::Syntax, "redifinition of object entry `", key).key());
+
+                uint32_t i = M_find(step, key.value());
+                if (i == npos)
+                {
+                    if (!Element::M_skip(lex, status))
+                        return false;
+                }
+                else
+                {
+                    seen[i] = 1;
+                    ++found;
+
+                    if (!M_extract(lex, i, seen, false, status))
+                        return false;
+                    if (partial && found == step.count)
+                        return true;
+                }
+
+                if (!Element::M_next(lex))
+                    break;
+            }
+            if (!Element::M_close(lex, Token::RightBrace, status))
+                return false;
+
+            if (found == step.count)
+                return true;
+
+            for (uint32_t i = step.first; i < step.first + step.count; ++i)
+            {
+                if (!seen[i])
+                    return M_fail(status, Status(Status::Missing, "json::Object::extract: missing element `", open).key(m_steps[i].key));
+            }
         }
+        else
+        {
+            if (!Element::M_expect(lex, Node::Array, "json::Array::extract: type mismatch", status))
+                return false;
+            Token open = lex.get();
+
+            uint32_t i = 0;
+            for (; lex.seek().type() != Token::RightBracket; ++i)
+            {
+                if (i < step.count)
+                    ok = M_extract(lex, step.first + i, seen, false, status);
+                else
+                    ok = Element::M_skip(lex, status);
+                if (!ok)
+                    return false;
+
+                if (!Element::M_next(lex))
+                {
+                    ++i;
+                    break;
+                }
+            }
+            if (!Element::M_close(lex, Token::RightBracket, status))
+                return false;
 
-        return new StringNode(ss.str());
+            if (i < step.count)
+                return M_fail(status, Status(Status::Size, "json::Array::extract: size mismatch in array", open));
+        }
+        return true;
     }
 
-    bool isConst() const
-    { return m_is_const; }
-
 private:
-    T** m_ptr;
-    std::size_t* m_size;
-    bool m_is_const;
+    Template m_template;
+    std::vector<Step> m_steps;
+    std::vector<uint32_t> m_table;
 };
 
-//! Used to tag types as RAW
-template <typename T>
-struct tag_as_raw_impl
+inline Plan Template::compile() const
+{ return Plan(*this); }
+
+inline PushParser::PushParser(Template const& tpl, Handler handler) :
+    m_handler([tpl = Template(tpl), handler](Node* node)
+    {
+        tpl.extract(node);
+        handler(node);
+    })
+{ reset(); }
+
+inline void Selector::select(Lexer& lex, Template const& tpl, std::function<void()> const& handler) const
 {
-public:
-    tag_as_raw_impl(T*& ptr, std::size_t& size) : ptr(ptr), size(size)
-    {}
+    if (!tpl.m_impl)
+        throw NodeError(lex.seek(), "json::Template::extract: template is not bound !");
 
-    T*& ptr;
-    std::size_t& size;
-};
+    Stats::Scope scope(Stats::Extracting);
+    M_select(lex, [&](Lexer& sub)
+    {
+        tpl.m_impl->extract(sub);
+        handler();
+    });
+}
 
-//! Used to tag types as RAW (const)
-template <typename T>
-struct tag_as_const_raw_impl
+inline bool StreamReader::extract(Template const& tpl)
 {
-public:
-    tag_as_const_raw_impl(T const* ptr, std::size_t size) : ptr(ptr), size(size)
-    {}
+    m_root = nullptr;
+    m_arena.release();
 
-    T const* ptr;
-    std::size_t size;
-};
+    if (m_lex.seek().type() == Token::Eof)
+        return false;
 
-//! Used to tag types as RAW
-template<typename T>
-static tag_as_raw_impl<T> ref_as_raw(T*& ptr, std::size_t& size)
-{ return tag_as_raw_impl<T>(ptr, size); }
+    tpl.extract(m_lex);
+    return true;
+}
 
-template<typename T>
-static tag_as_const_raw_impl<T> ref_as_raw(T const* ptr, std::size_t size)
-{ return tag_as_const_raw_impl<T>(ptr, size); }
+inline bool StreamReader::extract(Plan const& plan)
+{
+    m_root = nullptr;
+    m_arena.release();
 
-//! Generic vector element.
-template <typename T>
-class Vector : public Element
+    if (m_lex.seek().type() == Token::Eof)
+        return false;
+
+    plan.extract(m_lex);
+    return true;
+}
+
+//!
+//! Below are the hacks to handle the std::vector<bool> specialization,
+//!   for which the operator[] does not return a bool& but a special
+//!   proxy class
+//!
+
+//! Generic scalar element.
+//! We must use the hack of allocating a copy of the vector::reference,
+//!   because if we store by value we violate the constness of extract,
+//!   and if we store it by reference there is an "always true" bug
+template <Node::Type tp, typename N>
+class Scalar<tp, N, std::vector<bool>::reference> : public Element
 {
 public:
-    Vector(std::vector<T>& ref) :
-        m_temp(nullptr),
-        m_ref(ref),
+    Scalar(std::vector<bool>::reference& ref) :
+        m_ref(new std::vector<bool>::reference(ref)),
         m_is_const(false)
     {}
 
-    Vector(std::vector<T> const& const_ref) :
-        m_temp(nullptr),
-        m_ref(const_cast<std::vector<T>&>(const_ref)),
-        m_is_const(true)
-    {}
-
-    Vector(std::vector<T>&& temp) :
-        m_temp(std::make_unique<std::vector<T>>(temp)),
-        m_ref(*m_temp),
-        m_is_const(true)
-    {}
+    ~Scalar()
+    { delete m_ref; }
     
     Type type() const
-    { return Element::Vector; }
+    { return Element::Scalar; }
     
     void extract(Node* node) const
     {
         if (m_is_const)
-            throw NodeError(node, "json::Vector[const]::extract: extracting to const binding");
+            throw NodeError(node, "json::Scalar[const]::extract: extracting to const binding");
 
-        if (node->type() != Node::Array)
-            throw NodeError(node, "json::Vector::extract: expecting an array node");
-        
-        ArrayNode* arr = node->downcast<ArrayNode>();
-        
-        m_ref.clear();
-        m_ref.reserve(arr->size());
-        for (unsigned int i = 0; i < arr->size(); ++i)
-        {
-            T value;
-            Terminal<T> term(value);
-            term.extract(arr->at(i));
-            m_ref.push_back(value);
-        }
+        if (node->type() != tp)
+            throw NodeError(node, "json::Scalar::extract: expecting a node of type " + Node::typeName(tp));
+        *m_ref = node->downcast<N>()->value();
+    }
+
+    void extract(Lexer& lex) const
+    {
+        if (M_include(lex))
+            return;
+
+        if (m_is_const)
+            throw NodeError(lex.seek(), "json::Scalar[const]::extract: extracting to const binding");
+
+        if (!M_expect(lex, tp))
+            throw NodeError(lex.seek(), "json::Scalar::extract: expecting a node of type " + Node::typeName(tp));
+        *m_ref = lex.get().type() == Token::True;
     }
     
     Node* synthetize() const
+    { return new N(*m_ref); }
+
+    void write(Writer& out, int level, bool indent) const
     {
-        ArrayNode* arr = new ArrayNode();
-        for (unsigned int i = 0; i < m_ref.size(); ++i)
-        {
-            Terminal<T> term(m_ref[i]);
-            arr->impl().push_back(term.synthetize());
-        }
-        return arr;
+        if (indent) out.indent(level);
+        out.boolean(*m_ref);
     }
 
+    bool multiline() const
+    { return false; }
+
     bool isConst() const
     { return m_is_const; }
     
-private:
-    std::unique_ptr<std::vector<T>> m_temp;
-    std::vector<T>& m_ref;
+protected:
+    std::vector<bool>::reference* m_ref;
     bool m_is_const;
 };
 
-//! Generic map element.
-template <typename T>
-class Map : public Element
+template <>
+class Terminal<std::vector<bool>::reference> : public Scalar<Node::Boolean, BooleanNode, std::vector<bool>::reference>
 {
 public:
-    Map(std::map<std::string, T>& ref) :
-        m_temp(nullptr),
-        m_ref(ref),
-        m_is_const(false)
+    Terminal(std::vector<bool>::reference ref) : Scalar(ref)
     {}
+};
 
-    Map(std::map<std::string, T> const& ref) :
-        m_temp(nullptr),
-        m_ref(const_cast<std::map<std::string, T>&>(ref)),
-        m_is_const(true)
+//! Generic vector element.
+template <>
+class Vector<bool> : public Element
+{
+public:
+    Vector(std::vector<bool>& ref) :
+        m_ref(ref),
+        m_is_const(false)
     {}
 
-    Map(std::map<std::string, T>&& temp) :
-        m_temp(std::make_unique<T>(temp)),
-        m_ref(*m_temp),
+    Vector(std::vector<bool> const& ref) :
+        m_ref(const_cast<std::vector<bool>&>(ref)),
         m_is_const(true)
     {}
     
     Type type() const
-    { return Element::Map; }
+    { return Element::Vector; }
     
     void extract(Node* node) const
-    {
-        if (m_is_const)
-            throw NodeError(node, "json::Map[const]::extract: extracting to const binding");
+    { M_extract(node, nullptr); }
 
-        if (node->type() != Node::Object)
-            throw NodeError(node, "json::Map::extract: expecting an object node");
-        
-        ObjectNode* obj = node->downcast<ObjectNode>();
-        
-        m_ref.clear();
-        for (std::map<std::string, Node*>::iterator it = obj->impl().begin();
-            it != obj->impl().end(); ++it)
+    bool extract(Node* node, Status& status) const
+    { return M_extract(node, &status); }
+
+    void extract(Lexer& lex) const
+    { M_extract(lex, nullptr); }
+
+    bool extract(Lexer& lex, Status& status) const
+    { return M_extract(lex, &status); }
+    
+    Node* synthetize() const
+    {
+        ArrayNode* arr = new ArrayNode();
+        for (unsigned int i = 0; i < m_ref.size(); ++i)
         {
-            T value;
-            Terminal<T> term(value);
-            term.extract(it->second);
-            m_ref[it->first] = value;
+            Terminal<std::vector<bool>::reference> term(m_ref[i]);
+            arr->impl().push_back(term.synthetize());
         }
+        return arr;
     }
-    
-    Node* synthetize() const
+
+    void write(Writer& out, int level, bool indent) const
     {
-        ObjectNode* obj = new ObjectNode();
-        for (typename std::map<std::string, T>::iterator it = m_ref.begin();
-            it != m_ref.end(); ++it)
+        M_open(out, '[', level, indent, false);
+        for (std::size_t i = 0; i < m_ref.size(); ++i)
         {
-            T value;
-            Terminal<T> term(it->second);
-            obj->impl()[it->first] = term.synthetize();
+            if (i) out.write(", ");
+            out.boolean(m_ref[i]);
         }
-        return obj;
+        M_end(out, ']', level, false);
     }
 
+    bool multiline() const
+    { return false; }
+
     bool isConst() const
     { return m_is_const; }
     
 private:
-    std::unique_ptr<std::map<std::string, T>> m_temp;
-    std::map<std::string, T>& m_ref;
-    bool m_is_const;
-};
-
-//! Below are the specializations for the Terminal
-//!   element class.
-//! Instances that are not specialized here will systematically trigger errors
-//!   (see beginning of this file).
-
-template <>
-class Terminal<int32_t> : public Scalar<Node::Number, NumberNode, int32_t>
-{
-public:
-    using Scalar::Scalar;
-};
+    //! Extract, either throwing or reporting errors through the status.
+    bool M_extract(Node* node, Status* status) const
+    {
+        if (m_is_const)
+            return M_fail(status, Status(Status::Other, "json::Vector[const]::extract: extracting to const binding", node));
 
-template <>
-class Terminal<uint32_t> : public Scalar<Node::Number, NumberNode, uint32_t>
-{
-public:
-    using Scalar::Scalar;
-};
+        if (node->type() != Node::Array)
+            return M_fail(status, Status(Status::Mismatch, "json::Vector::extract: expecting an array node", node));
+        
+        ArrayNode const* arr = node->downcast<ArrayNode>();
+        
+        m_ref.clear();
+        m_ref.reserve(arr->size());
+        for (unsigned int i = 0; i < arr->size(); ++i)
+        {
+            bool value;
+            Terminal<bool> term(value);
+            if (!M_extractChild(term, M_item(arr, i), status))
+                return false;
+            m_ref.push_back(value);
+        }
+        return true;
+    }
 
-template <>
-class Terminal<int64_t> : public Scalar<Node::Number, NumberNode, int64_t>
-{
-public:
-    using Scalar::Scalar;
-};
+    bool M_extract(Lexer& lex, Status* status) const
+    {
+        bool ok = true;
+        if (M_include(lex, [&](Lexer& sub) { ok = M_extract(sub, status); }))
+            return ok;
 
-template <>
-class Terminal<uint64_t> : public Scalar<Node::Number, NumberNode, uint64_t>
-{
-public:
-    using Scalar::Scalar;
-};
+        if (m_is_const)
+            return M_fail(status, Status(Status::Other, "json::Vector[const]::extract: extracting to const binding", lex.seek()));
 
-template <>
-class Terminal<float> : public Scalar<Node::Number, NumberNode, float>
-{
-public:
-    using Scalar::Scalar;
-};
+        if (!M_expect(lex, Node::Array, "json::Vector::extract: expecting an array node", status))
+            return false;
+        lex.get();
 
-template <>
-class Terminal<double> : public Scalar<Node::Number, NumberNode, double>
-{
-public:
-    using Scalar::Scalar;
-};
+        m_ref.clear();
+        while (lex.seek().type() != Token::RightBracket)
+        {
+            bool value;
+            Terminal<bool> term(value);
+            if (!M_extractChild(term, lex, status))
+                return false;
+            m_ref.push_back(value);
 
-template <>
-class Terminal<bool> : public Scalar<Node::Boolean, BooleanNode, bool>
-{
-public:
-    using Scalar::Scalar;
-};
+            if (!M_next(lex))
+                break;
+        }
+        return M_close(lex, Token::RightBracket, status);
+    }
 
-template <>
-class Terminal<std::string> : public Scalar<Node::String, StringNode, std::string>
-{
-public:
-    using Scalar::Scalar;
+    std::vector<bool>& m_ref;
+    bool m_is_const;
 };
 
-template <>
-class Terminal<const char*> : public Scalar<Node::String, StringNode, std::string>
-{
-public:
-    Terminal(const char* ptr) :
-        Scalar(static_cast<std::string const&>(m_str)),
-        m_str(ptr)
-    {}
+// --------------------------------------------------------------------------------------
+// Reflection
+// --------------------------------------------------------------------------------------
 
-private:
-    std::string m_str;
-};
+//! Reflect the fields of a type (up to 32 of them), so that its values
+//!   are extracted and serialized by its static codec (see Codec), for
+//!   instance:
+//!     struct Point { int x, y; };
+//!     JSON_FIELDS(Point, x, y)
+//! It must be used in the namespace of the type, and defines the function
+//!   json_fields(Point const*), that returns the names of the fields and
+//!   pointers to them (which may also be written by hand).
+#define JSON_FIELDS(type, ...) \
+    constexpr auto json_fields(type const*) \
+    { return std::make_tuple(JSON_FIELDS_LIST_(type, __VA_ARGS__)); }
+
+#define JSON_FIELD_(type, name) std::make_pair(#name, &type::name)
+#define JSON_FIELDS_COUNT_(...) \
+    JSON_FIELDS_NTH_(__VA_ARGS__, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1)
+#define JSON_FIELDS_NTH_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, n, ...) n
+#define JSON_FIELDS_CAT_(a, b) JSON_FIELDS_CAT2_(a, b)
+#define JSON_FIELDS_CAT2_(a, b) a##b
+#define JSON_FIELDS_LIST_(type, ...) \
+    JSON_FIELDS_CAT_(JSON_FIELDS_LIST_, JSON_FIELDS_COUNT_(__VA_ARGS__))(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_1(type, a) JSON_FIELD_(type, a)
+#define JSON_FIELDS_LIST_2(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_1(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_3(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_2(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_4(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_3(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_5(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_4(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_6(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_5(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_7(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_6(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_8(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_7(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_9(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_8(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_10(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_9(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_11(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_10(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_12(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_11(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_13(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_12(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_14(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_13(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_15(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_14(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_16(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_15(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_17(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_16(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_18(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_17(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_19(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_18(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_20(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_19(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_21(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_20(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_22(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_21(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_23(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_22(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_24(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_23(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_25(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_24(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_26(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_25(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_27(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_26(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_28(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_27(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_29(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_28(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_30(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_29(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_31(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_30(type, __VA_ARGS__)
+#define JSON_FIELDS_LIST_32(type, a, ...) JSON_FIELD_(type, a), JSON_FIELDS_LIST_31(type, __VA_ARGS__)
+
+//! Tell if a type is reflected, that is if a json_fields() function
+//!   (typically defined by JSON_FIELDS()) is found for it by
+//!   argument-dependent lookup.
+template <typename T, typename = void>
+struct is_reflected : std::false_type
+{};
 
 template <typename T>
-class Terminal<std::vector<T> > : public Vector<T>
+struct is_reflected<T, std::void_t<decltype(json_fields(static_cast<T const*>(nullptr)))> > : std::true_type
+{};
+
+//! Static codecs, extracting and serializing values directly from their
+//!   type: numbers, booleans, strings, vectors and maps of them, and
+//!   reflected types (see JSON_FIELDS()).
+//! No element is allocated, nor called virtually, and object keys are
+//!   hashed at compile time.
+//! Errors are the same as the ones of the template elements, and
+//!   unsupported types are rejected at compile time.
+template <typename T, typename E>
+struct Codec
 {
-public:
-    using Vector<T>::Vector;
+    static_assert(sizeof(T) == 0, "json::Codec: unsupported type (it may be reflected with JSON_FIELDS())");
 };
 
-template <typename T>
-class Terminal<std::map<std::string, T> > : public Map<T>
+//! Helpers of the codecs of objects.
+struct ObjectCodec
 {
-public:
-    using Map<T>::Map;
-};
+    //! Write an object entry (see Element::M_writeEntry()).
+    template <typename V>
+    static void M_entry(Writer& out, std::string_view key, V const& value, int level, bool indent, bool last)
+    {
+        if (indent) out.indent(level + 4);
+        out.string(key);
+        out.write(": ");
 
-template <typename T>
-class Terminal<tag_as_pod_impl<T> > : public POD<T>
-{
-public:
-    Terminal(tag_as_pod_impl<T> ref) : POD<T>(ref.ref)
-    {}
-};
+        if (indent && Codec<V>::multiline(value))
+        {
+            out.put('\n');
+            Codec<V>::write(out, value, level + 4, indent);
+        }
+        else
+        {
+            Codec<V>::write(out, value, 0, false);
+        }
 
-template <typename T>
-class Terminal<tag_as_const_pod_impl<T> > : public POD<T>
-{
-public:
-    Terminal(tag_as_const_pod_impl<T> ref) : POD<T>(ref.ref)
-    {}
+        if (!last) out.write(", ");
+        if (indent) out.put('\n');
+    }
 };
 
+//! Numbers.
 template <typename T>
-class Terminal<tag_as_raw_impl<T> > : public Raw<T>
+struct Codec<T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>::type>
 {
-public:
-    Terminal(tag_as_raw_impl<T> ref) : Raw<T>(ref.ptr, ref.size)
-    {}
-};
+    static void extract(Lexer& lex, T& value)
+    {
+        if (Element::M_include(lex, [&](Lexer& sub) { extract(sub, value); }))
+            return;
 
-template <typename T>
-class Terminal<tag_as_const_raw_impl<T> > : public Raw<T>
-{
-public:
-    Terminal(tag_as_const_raw_impl<T> ref) : Raw<T>(ref.ptr, ref.size)
-    {}
+        if (!Element::M_expect(lex, Node::Number))
+            throw NodeError(lex.seek(), "json::Scalar::extract: expecting a node of type Number");
+        value = NumberNode::convert<T>(lex.get());
+    }
+
+    static void extract(Node* node, T& value)
+    {
+        if (node->type() != Node::Number)
+            throw NodeError(node, "json::Scalar::extract: expecting a node of type Number");
+        value = node->downcast<NumberNode>()->as<T>();
+    }
+
+    static Node* synthetize(T const& value)
+    {
+        if constexpr (std::is_floating_point<T>::value && !std::is_same<T, float>::value)
+            return new NumberNode(static_cast<double>(value));
+        else
+            return new NumberNode(value);
+    }
+
+    static void write(Writer& out, T const& value, int level, bool indent)
+    {
+        if (indent) out.indent(level);
+        out.number(value);
+    }
+
+    static bool multiline(T const&)
+    { return false; }
 };
 
-//! An object element class.
-class Object : public Element
+//! Booleans.
+template <>
+struct Codec<bool>
 {
-public:
-    Object() {}
-    ~Object()
+    static void extract(Lexer& lex, bool& value)
     {
-        for (std::map<std::string, Element*>::const_iterator it = m_elements.begin();
-             it != m_elements.end(); ++it)
-        {
-            if (!--it->second->refs)
-                delete it->second;
-        }
+        if (Element::M_include(lex, [&](Lexer& sub) { extract(sub, value); }))
+            return;
+
+        if (!Element::M_expect(lex, Node::Boolean))
+            throw NodeError(lex.seek(), "json::Scalar::extract: expecting a node of type Boolean");
+        value = lex.get().type() == Token::True;
     }
-    
-    void bind(std::string const& name, Element* elem)
+
+    static void extract(Node* node, bool& value)
     {
-        if (m_elements.find(name) != m_elements.end())
-            throw std::runtime_error("json::Object::bind: element `" + name + "' is already bound");
-        
-        ++elem->refs;
-        m_elements[name] = elem;
+        if (node->type() != Node::Boolean)
+            throw NodeError(node, "json::Scalar::extract: expecting a node of type Boolean");
+        value = node->downcast<BooleanNode>()->value();
     }
 
-    Type type() const { return Element::Object; }
+    static Node* synthetize(bool value)
+    { return new BooleanNode(value); }
 
-    void extract(Node* node) const
+    static void write(Writer& out, bool value, int level, bool indent)
     {
-        if (node->type() != Node::Object)
-            throw NodeError(node, "json::Object::extract: type mismatch");
-        ObjectNode* obj = node->downcast<ObjectNode>();
-        
-        for (std::map<std::string, Element*>::const_iterator it = m_elements.begin();
-             it != m_elements.end(); ++it)
-        {
-            if (!obj->exists(it->first))
-                throw NodeError(node, "json::Object::extract: missing element `" + it->first + "'");
-            
-            it->second->extract(obj->get(it->first));
-        }
+        if (indent) out.indent(level);
+        out.boolean(value);
     }
 
-    Node* synthetize() const
+    static bool multiline(bool)
+    { return false; }
+};
+
+//! Strings.
+template <>
+struct Codec<std::string>
+{
+    static void extract(Lexer& lex, std::string& value)
     {
-        ObjectNode* obj = new ObjectNode();
-        for (std::map<std::string, Element*>::const_iterator it = m_elements.begin();
-             it != m_elements.end(); ++it)
-        {
-            obj->impl()[it->first] = it->second->synthetize();
-        }
-        return obj;
+        if (Element::M_include(lex, [&](Lexer& sub) { extract(sub, value); }))
+            return;
+
+        if (!Element::M_expect(lex, Node::String))
+            throw NodeError(lex.seek(), "json::Scalar::extract: expecting a node of type String");
+        value = lex.get().release();
     }
 
-    bool isConst() const { return false; }
-    
-private:
-    std::map<std::string, Element*> m_elements;
+    static void extract(Node* node, std::string& value)
+    {
+        if (node->type() != Node::String)
+            throw NodeError(node, "json::Scalar::extract: expecting a node of type String");
+        value = node->downcast<StringNode>()->value();
+    }
+
+    static Node* synthetize(std::string const& value)
+    { return new StringNode(value); }
+
+    static void write(Writer& out, std::string const& value, int level, bool indent)
+    {
+        if (indent) out.indent(level);
+        out.string(value);
+    }
+
+    static bool multiline(std::string const&)
+    { return false; }
 };
 
-//! An array element class.
-class Array : public Element
+//! Vectors (formatted as Vector does).
+template <typename T>
+struct Codec<std::vector<T> >
 {
-public:
-    Array() {}
-    ~Array()
+    static void extract(Lexer& lex, std::vector<T>& value)
     {
-        for (unsigned int i = 0; i < m_elements.size(); ++i)
+        if (Element::M_include(lex, [&](Lexer& sub) { extract(sub, value); }))
+            return;
+
+        if (!Element::M_expect(lex, Node::Array))
+            throw NodeError(lex.seek(), "json::Vector::extract: expecting an array node");
+        lex.get();
+
+        value.clear();
+        while (lex.seek().type() != Token::RightBracket)
         {
-            if (!--m_elements[i]->refs)
-                delete m_elements[i];
+            M_extractItem(value, [&](T& item) { Codec<T>::extract(lex, item); });
+
+            if (!Element::M_next(lex))
+                break;
         }
+        Element::M_close(lex, Token::RightBracket);
     }
-    
-    void bind(Element* elem)
+
+    static void extract(Node* node, std::vector<T>& value)
     {
-        ++elem->refs;
-        m_elements.push_back(elem);
-    }
+        if (node->type() != Node::Array)
+            throw NodeError(node, "json::Vector::extract: expecting an array node");
+        ArrayNode const* arr = node->downcast<ArrayNode>();
 
-    Type type() const { return Element::Array; }
+        if constexpr (M_numbers)
+        {
+            if (arr->packed())
+            {
+                value.resize(arr->size());
+                arr->numbers(value.data());
+                return;
+            }
+        }
 
-    void extract(Node* node) const
+        value.clear();
+        value.reserve(arr->size());
+        for (Node* child : arr->impl())
+            M_extractItem(value, [&](T& item) { Codec<T>::extract(child, item); });
+    }
+
+    static Node* synthetize(std::vector<T> const& value)
     {
-        if (node->type() != Node::Array)
-            throw NodeError(node, "json::Array::extract: type mismatch");
-        ArrayNode* arr = node->downcast<ArrayNode>();
-        
-        for (unsigned int i = 0; i < m_elements.size(); ++i)
+        std::unique_ptr<ArrayNode> arr(new ArrayNode());
+        if constexpr (M_numbers)
         {
-            if (i >= arr->size())
-                throw NodeError(node, "json::Array::extract: size mismatch in array");
-            
-            m_elements[i]->extract(arr->at(i));
+            if (JSON_PACKED_ARRAY_THRESHOLD && value.size() >= JSON_PACKED_ARRAY_THRESHOLD &&
+                arr->M_pack(value.data(), value.size()))
+                return arr.release();
         }
+
+        arr->impl().reserve(value.size());
+        for (auto const& item : value)
+            arr->impl().push_back(Codec<T>::synthetize(item));
+        return arr.release();
     }
 
-    Node* synthetize() const
+    static void write(Writer& out, std::vector<T> const& value, int level, bool indent)
     {
-        ArrayNode* arr = new ArrayNode();
-        for (unsigned int i = 0; i < m_elements.size(); ++i)
+        bool multi = indent && multiline(value);
+        Element::M_open(out, '[', level, indent, multi);
+        for (std::size_t i = 0; i < value.size(); ++i)
         {
-            arr->impl().push_back(m_elements[i]->synthetize());
+            if (multi)
+                Codec<T>::write(out, value[i], level + 4, true);
+            else
+                Codec<T>::write(out, value[i], 0, false);
+
+            if (i != value.size() - 1) out.write(", ");
+            if (multi) out.put('\n');
         }
-        return arr;
+        Element::M_end(out, ']', level, multi);
     }
 
-    bool isConst() const { return false; }
-    
-private:
-    std::vector<Element*> m_elements;
-};
+    static bool multiline(std::vector<T> const& value)
+    {
+        for (auto const& item : value)
+            if (Codec<T>::multiline(item))
+                return true;
+        return false;
+    }
 
-//! A small helper Element overloaded class
-//!   (that just defines type() const).
-class UserElement : public Element
-{
-public:
-    Type type() const
-    { return Element::User; }
+    static constexpr bool M_numbers = std::is_arithmetic<T>::value && !std::is_same<T, bool>::value;
+
+    //! Extract a new item in place (as Vector does).
+    template <typename F>
+    static void M_extractItem(std::vector<T>& value, F const& extract)
+    {
+        if constexpr (std::is_same<T, bool>::value)
+        {
+            bool item = false;
+            extract(item);
+            value.push_back(item);
+        }
+        else
+            extract(value.emplace_back());
+    }
 };
 
-//! The final JSON template class.
-class Template
+//! Maps of strings (formatted as Map does).
+template <typename T>
+struct Codec<std::map<std::string, T> > : ObjectCodec
 {
-public:
-    Template() : m_impl(nullptr) {}
-    Template(Template& cpy) : m_impl(nullptr) { operator=(cpy); }
-    Template(Template const& cpy) : m_impl(nullptr) { operator=(cpy); }
-    
-    ~Template()
-    { reset(); }
-    
-    Template& operator=(Template const& cpy)
+    static void extract(Lexer& lex, std::map<std::string, T>& value)
     {
-        m_impl = cpy.m_impl;
-        if (m_impl)
-            m_impl->refs++;
-        return *this;
-    }
-    
-    template <typename T>
-    Template(T& ref) :
-        m_impl(nullptr)
-    { bind(ref); }
+        if (Element::M_include(lex, [&](Lexer& sub) { extract(sub, value); }))
+            return;
 
-    template <typename T>
-    Template(T const& const_ref) :
-        m_impl(nullptr)
-    { bind(const_ref); }
+        if (!Element::M_expect(lex, Node::Object))
+            throw NodeError(lex.seek(), "json::Map::extract: expecting an object node");
+        lex.get();
 
-    template <typename T>
-    Template(T&& temp) :
-        m_impl(nullptr)
-    { bind(std::forward<T>(temp)); }
-    
-    template <typename T>
-    Template& bind(T& ref)
-    {
-        if (m_impl) throw std::runtime_error("json::Template::bind: template is already bound");
-        m_impl = new Terminal<T>(ref);
-        return *this;
+        value.clear();
+        while (lex.seek().type() != Token::RightBrace)
+        {
+            Token key = Element::M_key(lex);
+            auto res = value.try_emplace(key.release());
+            if (!res.second)
+                throw TokenError(key, "redifinition of object entry `" + res.first->first + "'");
+            Codec<T>::extract(lex, res.first->second);
+
+            if (!Element::M_next(lex))
+                break;
+        }
+        Element::M_close(lex, Token::RightBrace);
     }
-    
-    template <typename T>
-    Template& bind(T const& const_ref)
+
+    static void extract(Node* node, std::map<std::string, T>& value)
     {
-        if (m_impl) throw std::runtime_error("json::Template::bind: template is already bound");
-        m_impl = new Terminal<T>(const_ref);
-        return *this;
+        if (node->type() != Node::Object)
+            throw NodeError(node, "json::Map::extract: expecting an object node");
+
+        value.clear();
+        for (auto const& entry : node->downcast<ObjectNode>()->impl())
+            Codec<T>::extract(entry.second, value[entry.first.str()]);
     }
-    
-    template <typename T>
-    Template& bind(T&& temp)
+
+    static Node* synthetize(std::map<std::string, T> const& value)
     {
-        if (m_impl) throw std::runtime_error("json::Template::bind: template is already bound");
-        m_impl = new Terminal<T>(std::forward<T>(temp));
-        return *this;
+        std::unique_ptr<ObjectNode> obj(new ObjectNode());
+        for (auto const& entry : value)
+            obj->insert(Text(entry.first), Codec<T>::synthetize(entry.second));
+        return obj.release();
     }
-    
-    Template& bind(std::string const& name, Template const& tpl)
+
+    static void write(Writer& out, std::map<std::string, T> const& value, int level, bool indent)
     {
-        if (m_impl && m_impl->type() != Element::Object)
-            throw std::runtime_error("json::Template::bind: template is already bound");
-        
-        if (!m_impl)
-            m_impl = new Object();
-        
-        ((Object*) m_impl)->bind(name, tpl.m_impl);
-        return *this;
+        Element::M_open(out, '{', level, indent, indent);
+        for (auto it = value.begin(); it != value.end(); ++it)
+            M_entry(out, it->first, it->second, level, indent, std::next(it) == value.end());
+        Element::M_end(out, '}', level, indent);
     }
 
-    Template& bind_array(Template const& tpl)
-    {
-        if (m_impl && m_impl->type() != Element::Array)
-            throw std::runtime_error("json::Template::bind_array: template is already bound");
-        
-        if (!m_impl)
-            m_impl = new Array();
-        
-        ((Array*) m_impl)->bind(tpl.m_impl);
-        return *this;
+    static bool multiline(std::map<std::string, T> const&)
+    { return true; }
+};
+
+//! Reflected types, as objects whose entries are their fields (written
+//!   in their declaration order).
+//! All the fields are required, and other entries are skipped.
+template <typename T>
+struct Codec<T, typename std::enable_if<is_reflected<T>::value>::type> : ObjectCodec
+{
+    //! Names of the fields, and pointers to them
+    static constexpr auto fields = json_fields(static_cast<T const*>(nullptr));
+    static constexpr std::size_t size = std::tuple_size<decltype(fields)>::value;
+
+    static void extract(Lexer& lex, T& value)
+    {
+        if (Element::M_include(lex, [&](Lexer& sub) { extract(sub, value); }))
+            return;
+
+        if (!Element::M_expect(lex, Node::Object))
+            throw NodeError(lex.seek(), "json::Object::extract: type mismatch");
+        Token open = lex.get();
+
+        ObjectKeys keys;
+        std::bitset<size> seen;
+        while (lex.seek().type() != Token::RightBrace)
+        {
+            Token key = Element::M_key(lex);
+            if (!keys.insert(key.text()))
+                throw TokenError(key, "redifinition of object entry `" + key.text().str() + "'");
+            if (!M_field(lex, key, value, seen, Indices()))
+                Parser(lex).skip();
+
+            if (!Element::M_next(lex))
+                break;
+        }
+        Element::M_close(lex, Token::RightBrace);
+
+        if (!seen.all())
+        {
+            M_each([&](auto i)
+            {
+                if (!seen[i])
+                    throw NodeError(open, "json::Object::extract: missing element `" + std::string(M_name<i>()) + "'");
+            });
+        }
     }
 
-    bool bound() const { return m_impl; }
-    operator bool() const { return bound(); }
-    
-    void extract(Node* node) const
+    static void extract(Node* node, T& value)
     {
-        if (!m_impl)
-            throw NodeError(node, "json::Template::extract: template is not bound !");
-        
-        m_impl->extract(node);
+        if (node->type() != Node::Object)
+            throw NodeError(node, "json::Object::extract: type mismatch");
+        ObjectNode* obj = node->downcast<ObjectNode>();
+
+        M_each([&](auto i)
+        {
+            constexpr std::string_view name = M_name<i>();
+            Node* child = obj->find(name, ObjectNode::hash(name));
+            if (!child)
+                throw NodeError(node, "json::Object::extract: missing element `" + std::string(name) + "'");
+
+            auto& field = value.*std::get<i>(fields).second;
+            Codec<std::decay_t<decltype(field)> >::extract(child, field);
+        });
     }
 
-    Node* synthetize() const
+    static Node* synthetize(T const& value)
     {
-        if (!m_impl)
-            throw std::runtime_error("json::Template::synthetize: template is not bound !");
-        
-        return m_impl->synthetize();
+        std::unique_ptr<ObjectNode> obj(new ObjectNode());
+        M_each([&](auto i)
+        {
+            auto const& field = value.*std::get<i>(fields).second;
+            obj->insert(Text::reference(M_name<i>()), Codec<std::decay_t<decltype(field)> >::synthetize(field));
+        });
+        return obj.release();
     }
 
-    void reset()
+    static void write(Writer& out, T const& value, int level, bool indent)
     {
-        if (m_impl && !--m_impl->refs)
-            delete m_impl;
-        m_impl = nullptr;
+        Element::M_open(out, '{', level, indent, indent);
+        M_each([&](auto i)
+        {
+            M_entry(out, M_name<i>(), value.*std::get<i>(fields).second, level, indent, i + 1 == size);
+        });
+        Element::M_end(out, '}', level, indent);
     }
-    
+
+    static bool multiline(T const&)
+    { return true; }
+
 private:
-    Element* m_impl;
-};
+    typedef std::make_index_sequence<size> Indices;
 
-//!
-//! Below are the hacks to handle the std::vector<bool> specialization,
-//!   for which the operator[] does not return a bool& but a special
-//!   proxy class
-//!
+    template <std::size_t I>
+    static constexpr std::string_view M_name()
+    { return std::get<I>(fields).first; }
 
-//! Generic scalar element.
-//! We must use the hack of allocating a copy of the vector::reference,
-//!   because if we store by value we violate the constness of extract,
-//!   and if we store it by reference there is an "always true" bug
-template <Node::Type tp, typename N>
-class Scalar<tp, N, std::vector<bool>::reference> : public Element
-{
-public:
-    Scalar(std::vector<bool>::reference& ref) :
-        m_ref(new std::vector<bool>::reference(ref)),
-        m_is_const(false)
-    {}
+    //! Call f with each field index (as an integral constant).
+    template <typename F>
+    static void M_each(F const& f)
+    { M_each(f, Indices()); }
 
-    ~Scalar()
-    { delete m_ref; }
-    
-    Type type() const
-    { return Element::Scalar; }
-    
-    void extract(Node* node) const
-    {
-        if (m_is_const)
-            throw NodeError(node, "json::Scalar[const]::extract: extracting to const binding");
+    template <typename F, std::size_t... I>
+    static void M_each(F const& f, std::index_sequence<I...>)
+    { (f(std::integral_constant<std::size_t, I>()), ...); }
 
-        if (node->type() != tp)
-            throw NodeError(node, "json::Scalar::extract: expecting a node of type " + Node::typeName(tp));
-        *m_ref = node->downcast<N>()->value();
+    //! Extract the field of the given key, if any (telling if there is one).
+    template <std::size_t... I>
+    static bool M_field(Lexer& lex, Token const& key, T& value, std::bitset<size>& seen, std::index_sequence<I...>)
+    {
+        std::string_view name = key.value();
+        uint32_t h = ObjectNode::hash(name);
+        return (M_field<I>(lex, name, h, value, seen) || ...);
     }
-    
-    Node* synthetize() const
-    { return new N(*m_ref); }
 
-    bool isConst() const
-    { return m_is_const; }
-    
-protected:
-    std::vector<bool>::reference* m_ref;
-    bool m_is_const;
-};
+    template <std::size_t I>
+    static bool M_field(Lexer& lex, std::string_view name, uint32_t h, T& value, std::bitset<size>& seen)
+    {
+        constexpr uint32_t hash = ObjectNode::hash(M_name<I>());
+        if (h != hash || name != M_name<I>())
+            return false;
 
-template <>
-class Terminal<std::vector<bool>::reference> : public Scalar<Node::Boolean, BooleanNode, std::vector<bool>::reference>
-{
-public:
-    Terminal(std::vector<bool>::reference ref) : Scalar(ref)
-    {}
+        seen.set(I);
+
+        auto& field = value.*std::get<I>(fields).second;
+        Codec<std::decay_t<decltype(field)> >::extract(lex, field);
+        return true;
+    }
 };
 
-//! Generic vector element.
-template <>
-class Vector<bool> : public Element
+//! The element of a value whose type has a codec (reflected types, when
+//!   bound to templates).
+template <typename T>
+class Reflected : public UserElement
 {
 public:
-    Vector(std::vector<bool>& ref) :
+    Reflected(T& ref) :
+        m_temp(nullptr),
         m_ref(ref),
         m_is_const(false)
     {}
 
-    Vector(std::vector<bool> const& ref) :
-        m_ref(const_cast<std::vector<bool>&>(ref)),
+    Reflected(T const& const_ref) :
+        m_temp(nullptr),
+        m_ref(const_cast<T&>(const_ref)),
         m_is_const(true)
     {}
-    
-    Type type() const
-    { return Element::Vector; }
-    
+
+    Reflected(T&& temp) :
+        m_temp(std::make_unique<T>(std::move(temp))),
+        m_ref(*m_temp),
+        m_is_const(true)
+    {}
+
     void extract(Node* node) const
     {
         if (m_is_const)
-            throw NodeError(node, "json::Vector[const]::extract: extracting to const binding");
-
-        if (node->type() != Node::Array)
-            throw NodeError(node, "json::Vector::extract: expecting an array node");
-        
-        ArrayNode* arr = node->downcast<ArrayNode>();
-        
-        m_ref.clear();
-        m_ref.reserve(arr->size());
-        for (unsigned int i = 0; i < arr->size(); ++i)
-        {
-            bool value;
-            Terminal<bool> term(value);
-            term.extract(arr->at(i));
-            m_ref.push_back(value);
-        }
+            throw NodeError(node, "json::Reflected[const]::extract: extracting to const binding");
+        Codec<T>::extract(node, m_ref);
     }
-    
-    Node* synthetize() const
+
+    void extract(Lexer& lex) const
     {
-        ArrayNode* arr = new ArrayNode();
-        for (unsigned int i = 0; i < m_ref.size(); ++i)
-        {
-            Terminal<std::vector<bool>::reference> term(m_ref[i]);
-            arr->impl().push_back(term.synthetize());
-        }
-        return arr;
+        if (m_is_const)
+            throw NodeError(lex.seek(), "json::Reflected[const]::extract: extracting to const binding");
+        Codec<T>::extract(lex, m_ref);
     }
 
+    Node* synthetize() const
+    { return Codec<T>::synthetize(m_ref); }
+
+    void write(Writer& out, int level, bool indent) const
+    { Codec<T>::write(out, m_ref, level, indent); }
+
+    bool multiline() const
+    { return Codec<T>::multiline(m_ref); }
+
     bool isConst() const
     { return m_is_const; }
-    
+
 private:
-    std::vector<bool>& m_ref;
+    std::unique_ptr<T> m_temp;
+    T& m_ref;
     bool m_is_const;
 };
 
+template <typename T>
+class Terminal<T, typename std::enable_if<is_reflected<T>::value>::type> : public Reflected<T>
+{
+public:
+    using Reflected<T>::Reflected;
+};
+
 // --------------------------------------------------------------------------------------
 // Utility functions
 // --------------------------------------------------------------------------------------
 
 Node* parse(std::string const& file)
 {
-    std::ifstream fs(file, std::ios::in);
-    if (!fs)
+    MappedFile map;
+    if (!map.open(file))
         throw std::runtime_error("json::parse: unable to open \"" + file + "\"");
-    return parse(fs);
+    return parse(map.data(), map.size());
 }
 
 Node* parse(std::istream& file)
@@ -1945,6 +9207,38 @@ Node* parse(std::istream& file)
     return parser.parse();
 }
 
+Node* parse(const char* data, std::size_t size)
+{
+    Lexer lexer(data, size);
+    Parser parser(lexer);
+    return parser.parse();
+}
+
+Node* parse(std::string const& file, Status& status)
+{
+    MappedFile map;
+    if (!map.open(file))
+    {
+        status = Status::from(std::runtime_error("json::parse: unable to open \"" + file + "\""));
+        return nullptr;
+    }
+    return parse(map.data(), map.size(), status);
+}
+
+Node* parse(std::istream& file, Status& status)
+{
+    Lexer lexer(file);
+    Parser parser(lexer);
+    return parser.parse(status);
+}
+
+Node* parse(const char* data, std::size_t size, Status& status)
+{
+    Lexer lexer(data, size);
+    Parser parser(lexer);
+    return parser.parse(status);
+}
+
 void serialize(Node* node, std::string const& file, bool indent)
 {
     std::ofstream fs(file, std::ios::out);
@@ -1958,32 +9252,189 @@ void serialize(Node* node, std::ostream& file, bool indent)
     node->serialize(file, indent);
 }
 
+Node* parse_binary(std::string const& file)
+{
+    MappedFile map;
+    if (!map.open(file))
+        throw std::runtime_error("json::parse_binary: unable to open \"" + file + "\"");
+    return Binary::decode(map.data(), map.size());
+}
+
+Node* parse_binary(std::istream& file)
+{
+    std::string data(std::istreambuf_iterator<char>(file), {});
+    return Binary::decode(data.data(), data.size());
+}
+
+Node* parse_binary(const char* data, std::size_t size)
+{
+    return Binary::decode(data, size);
+}
+
+void serialize_binary(Node* node, std::string const& file)
+{
+    std::ofstream fs(file, std::ios::out | std::ios::binary);
+    if (!fs)
+        throw std::runtime_error("json::serialize_binary: unable to open \"" + file + "\"");
+    serialize_binary(node, fs);
+}
+
+void serialize_binary(Node* node, std::ostream& file)
+{
+    std::string data = Binary::encode(node);
+    file.write(data.data(), data.size());
+}
+
 void extract(Template const& tpl, std::string const& file)
 {
-    Node* node = parse(file);
-    tpl.extract(node);
-    delete node;
+    MappedFile map;
+    if (!map.open(file))
+        throw std::runtime_error("json::parse: unable to open \"" + file + "\"");
+
+    Lexer lexer(map.data(), map.size());
+    tpl.extract(lexer);
 }
 
 void extract(Template const& tpl, std::istream& file)
 {
-    Node* node = parse(file);
-    tpl.extract(node);
-    delete node;
+    Lexer lexer(file);
+    tpl.extract(lexer);
+}
+
+void extract(Plan const& plan, std::string const& file)
+{
+    MappedFile map;
+    if (!map.open(file))
+        throw std::runtime_error("json::parse: unable to open \"" + file + "\"");
+
+    Lexer lexer(map.data(), map.size());
+    plan.extract(lexer);
+}
+
+void extract(Plan const& plan, std::istream& file)
+{
+    Lexer lexer(file);
+    plan.extract(lexer);
+}
+
+bool extract(Template const& tpl, std::string const& file, Status& status)
+{
+    MappedFile map;
+    if (!map.open(file))
+    {
+        status = Status::from(std::runtime_error("json::parse: unable to open \"" + file + "\""));
+        return false;
+    }
+
+    Lexer lexer(map.data(), map.size());
+    return tpl.extract(lexer, status);
+}
+
+bool extract(Template const& tpl, std::istream& file, Status& status)
+{
+    Lexer lexer(file);
+    return tpl.extract(lexer, status);
+}
+
+bool extract(Plan const& plan, std::string const& file, Status& status)
+{
+    MappedFile map;
+    if (!map.open(file))
+    {
+        status = Status::from(std::runtime_error("json::parse: unable to open \"" + file + "\""));
+        return false;
+    }
+
+    Lexer lexer(map.data(), map.size());
+    return plan.extract(lexer, status);
+}
+
+bool extract(Plan const& plan, std::istream& file, Status& status)
+{
+    Lexer lexer(file);
+    return plan.extract(lexer, status);
+}
+
+void extract_partial(Template const& tpl, std::string const& file)
+{
+    MappedFile map;
+    if (!map.open(file))
+        throw std::runtime_error("json::parse: unable to open \"" + file + "\"");
+
+    Lexer lexer(map.data(), map.size());
+    tpl.extractPartial(lexer);
+}
+
+void extract_partial(Template const& tpl, std::istream& file)
+{
+    Lexer lexer(file);
+    tpl.extractPartial(lexer);
+}
+
+void extract_partial(Plan const& plan, std::string const& file)
+{
+    MappedFile map;
+    if (!map.open(file))
+        throw std::runtime_error("json::parse: unable to open \"" + file + "\"");
+
+    Lexer lexer(map.data(), map.size());
+    plan.extractPartial(lexer);
+}
+
+void extract_partial(Plan const& plan, std::istream& file)
+{
+    Lexer lexer(file);
+    plan.extractPartial(lexer);
+}
+
+template <typename H>
+void read(std::string const& file, H& handler)
+{
+    MappedFile map;
+    if (!map.open(file))
+        throw std::runtime_error("json::parse: unable to open \"" + file + "\"");
+
+    Lexer lexer(map.data(), map.size(), true);
+    Reader<H> reader(lexer, handler);
+    reader.read();
+}
+
+template <typename H>
+void read(std::istream& file, H& handler)
+{
+    Lexer lexer(file);
+    Reader<H> reader(lexer, handler);
+    reader.read();
+}
+
+std::vector<Node*> select(std::string const& file, std::string const& path)
+{
+    MappedFile map;
+    if (!map.open(file))
+        throw std::runtime_error("json::parse: unable to open \"" + file + "\"");
+
+    Lexer lexer(map.data(), map.size());
+    return Selector(path).select(lexer);
+}
+
+std::vector<Node*> select(std::istream& file, std::string const& path)
+{
+    Lexer lexer(file);
+    return Selector(path).select(lexer);
 }
 
 void synthetize(Template const& tpl, std::string const& file, bool indent)
 {
-    Node* node = tpl.synthetize();
-    serialize(node, file, indent);
-    delete node;
+    std::ofstream fs(file, std::ios::out);
+    if (!fs)
+        throw std::runtime_error("json::synthetize: unable to open \"" + file + "\"");
+    synthetize(tpl, fs, indent);
 }
 
 void synthetize(Template const& tpl, std::ostream& file, bool indent)
 {
-    Node* node = tpl.synthetize();
-    serialize(node, file, indent);
-    delete node;
+    Writer out(file);
+    tpl.write(out, indent);
 }
 
 JSON_END_NAMESPACE